@@ -0,0 +1,337 @@
+#include "AsyncIO.h"
+#include <unistd.h>
+#include <sys/uio.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#if !defined(BPT_NO_IO_URING) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define BPT_HAVE_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+#endif
+
+
+static ssize_t transfer(const IoRequest& r) {
+    ssize_t moved = 0;
+    while (moved < r.len) {
+        ssize_t n = r.write ? pwrite(r.fd, r.buf + moved, r.len - moved, r.offset + moved)
+                            : pread(r.fd, r.buf + moved, r.len - moved, r.offset + moved);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return -errno;
+        if (n == 0) break;
+        moved += n;
+    }
+    return moved;
+}
+
+
+// A read the page cache can serve is done on the spot, by the submitting thread: handing it to
+// another thread would cost more than the copy.
+static bool readCached(const IoRequest& r) {
+#ifdef RWF_NOWAIT
+    if (r.write) return false;
+
+    struct iovec iov = { r.buf, (size_t)r.len };
+    ssize_t n = preadv2(r.fd, &iov, 1, r.offset, RWF_NOWAIT);
+    if (n != r.len) return false;
+
+    r.done(r.ctx, r.tag, n);
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+class ThreadPoolIO : public AsyncIO {
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::condition_variable space;
+    std::deque<IoRequest> queue;
+    int in_flight;
+    bool stopping;
+    std::vector<std::thread> workers;
+
+    void run();
+public:
+    ThreadPoolIO();
+    ~ThreadPoolIO();
+
+    void submit(const IoRequest& r);
+    void flush() {}
+    const char* backend() const { return "threads"; }
+};
+
+
+ThreadPoolIO::ThreadPoolIO() : in_flight(0), stopping(false) {
+    for (int i = 0; i < IO_THREADS; i++) workers.emplace_back(&ThreadPoolIO::run, this);
+}
+
+
+ThreadPoolIO::~ThreadPoolIO() {
+    {
+        std::lock_guard<std::mutex> lk(mutex);
+        stopping = true;
+    }
+    ready.notify_all();
+    for (size_t i = 0; i < workers.size(); i++) workers[i].join();
+}
+
+
+void ThreadPoolIO::run() {
+    while (true) {
+        std::unique_lock<std::mutex> lk(mutex);
+        ready.wait(lk, [this] { return stopping || !queue.empty(); });
+        if (queue.empty()) return;
+
+        IoRequest r = queue.front();
+        queue.pop_front();
+        lk.unlock();
+
+        r.done(r.ctx, r.tag, transfer(r));
+
+        lk.lock();
+        in_flight--;
+        lk.unlock();
+        space.notify_one();
+    }
+}
+
+
+void ThreadPoolIO::submit(const IoRequest& r) {
+    if (readCached(r)) return;
+
+    std::unique_lock<std::mutex> lk(mutex);
+    space.wait(lk, [this] { return in_flight < IO_QUEUE_DEPTH; });
+
+    queue.push_back(r);
+    in_flight++;
+    lk.unlock();
+    ready.notify_one();
+}
+
+
+#ifdef BPT_HAVE_IO_URING
+
+// io_uring driven through its system calls, so no library is needed. Submissions are serialized by
+// a mutex, as the submission ring has a single producer. Queued entries are pushed to the kernel
+// together by flush(), or by submit() once every slot is taken. A reaper thread waits for
+// completions and runs their callbacks; a NOP tagged STOP tells it to exit once every slot has come
+// back.
+class UringIO : public AsyncIO {
+    static const uint64_t STOP = ~0ULL;
+
+    struct Slot {
+        IoRequest req;
+        struct iovec iov;
+    };
+
+    int ring_fd;
+    void* sq_ring;
+    void* cq_ring;
+    size_t sq_ring_size;
+    size_t cq_ring_size;
+    io_uring_sqe* sqes;
+    size_t sqes_size;
+
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    io_uring_cqe* cqes;
+
+    std::vector<Slot> slots;
+    std::vector<int> free_slots;
+    unsigned queued;
+    std::mutex mutex;
+    std::condition_variable space;
+    std::thread reaper;
+
+    void push(int opcode, int fd, const struct iovec* iov, off_t offset, uint64_t data);
+    void enter();
+    void reap();
+public:
+    UringIO();
+    ~UringIO();
+
+    bool ok() const { return ring_fd >= 0; }
+    void submit(const IoRequest& r);
+    void flush();
+    const char* backend() const { return "io_uring"; }
+};
+
+
+UringIO::UringIO() : ring_fd(-1), sq_ring(MAP_FAILED), cq_ring(MAP_FAILED), sq_ring_size(0), cq_ring_size(0), sqes((io_uring_sqe*)MAP_FAILED), sqes_size(0), queued(0) {
+    io_uring_params p;
+    std::memset(&p, 0, sizeof(p));
+
+    int fd = syscall(__NR_io_uring_setup, IO_QUEUE_DEPTH, &p);
+    if (fd < 0) return;
+
+    sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+    if (single) sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+
+    sq_ring = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    cq_ring = single ? sq_ring : mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    sqes_size = p.sq_entries * sizeof(io_uring_sqe);
+    sqes = (io_uring_sqe*)mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+
+    if (sq_ring == MAP_FAILED || cq_ring == MAP_FAILED || sqes == MAP_FAILED) {
+        if (sqes != MAP_FAILED) munmap(sqes, sqes_size);
+        if (cq_ring != MAP_FAILED && !single) munmap(cq_ring, cq_ring_size);
+        if (sq_ring != MAP_FAILED) munmap(sq_ring, sq_ring_size);
+        close(fd);
+        return;
+    }
+
+    char* sq = (char*)sq_ring;
+    char* cq = (char*)cq_ring;
+    sq_tail = (unsigned*)(sq + p.sq_off.tail);
+    sq_mask = (unsigned*)(sq + p.sq_off.ring_mask);
+    sq_array = (unsigned*)(sq + p.sq_off.array);
+    cq_head = (unsigned*)(cq + p.cq_off.head);
+    cq_tail = (unsigned*)(cq + p.cq_off.tail);
+    cq_mask = (unsigned*)(cq + p.cq_off.ring_mask);
+    cqes = (io_uring_cqe*)(cq + p.cq_off.cqes);
+
+    ring_fd = fd;
+    slots.resize(p.sq_entries);
+    for (int i = p.sq_entries - 1; i >= 0; i--) free_slots.push_back(i);
+    reaper = std::thread(&UringIO::reap, this);
+}
+
+
+UringIO::~UringIO() {
+    if (ring_fd < 0) return;
+
+    {
+        std::unique_lock<std::mutex> lk(mutex);
+        enter();
+        space.wait(lk, [this] { return free_slots.size() == slots.size(); });
+        push(IORING_OP_NOP, -1, nullptr, 0, STOP);
+        enter();
+    }
+    reaper.join();
+
+    munmap(sqes, sqes_size);
+    if (cq_ring != sq_ring) munmap(cq_ring, cq_ring_size);
+    munmap(sq_ring, sq_ring_size);
+    close(ring_fd);
+}
+
+
+// Called with mutex held.
+void UringIO::push(int opcode, int fd, const struct iovec* iov, off_t offset, uint64_t data) {
+    unsigned tail = *sq_tail;
+    unsigned idx = tail & *sq_mask;
+
+    io_uring_sqe* sqe = &sqes[idx];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)iov;
+    sqe->len = iov ? 1 : 0;
+    sqe->off = offset;
+    sqe->user_data = data;
+
+    sq_array[idx] = idx;
+    __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+    queued++;
+}
+
+
+// Called with mutex held.
+void UringIO::enter() {
+    while (queued > 0) {
+        long n = syscall(__NR_io_uring_enter, ring_fd, queued, 0, 0, nullptr, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) {
+            perror("io_uring_enter");
+            exit(1);
+        }
+        queued -= n;
+    }
+}
+
+
+void UringIO::flush() {
+    std::lock_guard<std::mutex> lk(mutex);
+    enter();
+}
+
+
+void UringIO::submit(const IoRequest& r) {
+    if (readCached(r)) return;
+
+    std::unique_lock<std::mutex> lk(mutex);
+    while (free_slots.empty()) {
+        enter();
+        space.wait(lk);
+    }
+
+    int id = free_slots.back();
+    free_slots.pop_back();
+
+    Slot& s = slots[id];
+    s.req = r;
+    s.iov.iov_base = r.buf;
+    s.iov.iov_len = r.len;
+    push(r.write ? IORING_OP_WRITEV : IORING_OP_READV, r.fd, &s.iov, r.offset, id);
+}
+
+
+void UringIO::reap() {
+    while (true) {
+        unsigned head = *cq_head;
+        if (head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+            if (syscall(__NR_io_uring_enter, ring_fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno != EINTR) {
+                perror("io_uring_enter");
+                exit(1);
+            }
+            continue;
+        }
+
+        io_uring_cqe* c = &cqes[head & *cq_mask];
+        uint64_t data = c->user_data;
+        int res = c->res;
+        __atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+        if (data == STOP) return;
+
+        IoRequest r = slots[data].req;
+        r.done(r.ctx, r.tag, res);
+
+        {
+            std::lock_guard<std::mutex> lk(mutex);
+            free_slots.push_back((int)data);
+        }
+        space.notify_all();
+    }
+}
+
+#endif
+
+
+AsyncIO* AsyncIO::create() {
+#ifdef BPT_HAVE_IO_URING
+    UringIO* ring = new UringIO();
+    if (ring->ok()) return ring;
+    delete ring;
+#endif
+    return new ThreadPoolIO();
+}
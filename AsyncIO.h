@@ -0,0 +1,39 @@
+#ifndef ASYNC_IO_H
+#define ASYNC_IO_H
+
+#include "common.h"
+#include <sys/types.h>
+
+// One page transfer handed to the I/O backend. done runs once the transfer has finished, with the
+// number of bytes moved or -errno: on a backend thread, or on the submitting one before submit()
+// returns when a read could be served from the page cache.
+struct IoRequest {
+    int fd;
+    char* buf;
+    int len;
+    off_t offset;
+    bool write;
+    void (*done)(void* ctx, long tag, ssize_t res);
+    void* ctx;
+    long tag;
+};
+
+// Page reads and writes that run while the caller goes on. The io_uring backend submits through
+// the kernel's shared rings and reaps completions on one thread; where io_uring is not available
+// (an older kernel, a seccomp filter, or a build with -DBPT_NO_IO_URING) a small pool of threads
+// issues pread/pwrite instead. submit() only queues a request; flush() hands everything queued to
+// the kernel in one call, so a read-ahead window or a writeback pass costs one system call. A full
+// queue is flushed by submit() itself, and the thread backend starts every request at once. At most
+// IO_QUEUE_DEPTH requests are in flight; submit() waits for a completion beyond that. The destructor
+// waits for every submitted request.
+class AsyncIO {
+public:
+    virtual ~AsyncIO() {}
+    virtual void submit(const IoRequest& r) = 0;
+    virtual void flush() = 0;
+    virtual const char* backend() const = 0;
+
+    static AsyncIO* create();
+};
+
+#endif
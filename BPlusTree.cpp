@@ -5,24 +5,33 @@
 #include <vector>
 #include <cstdlib>
 
-BPlusTree::BPlusTree() {
+template <typename T>
+BasicBPlusTree<T>::BasicBPlusTree(int pool_frames, const char* path, const char* wal_path, BufferPool* shared_pool) {
 
-    dm = new DiskManager();
-    Page* meta = dm->getPage(0);
+    dm = new DiskManager(pool_frames, path, wal_path, T::PAGE, redo, shared_pool);
+    PageGuard meta = dm->getPage(0, LATCH_EXCLUSIVE);
     PageHeader* mh = meta->getHeader();
 
 
     if (mh->page_type == PAGE_INVALID) {
-        initPage(meta, 0, INVALID_PAGE_ID, PAGE_META);
-        root_page_id = dm->allocatePage();
-        Page* root = dm->getPage(root_page_id);
-        initPage(root, root_page_id, INVALID_PAGE_ID, PAGE_LEAF);
-        
+        initPage(meta.get(), 0, PAGE_META, 0);
+
         MetaPageData* mp = reinterpret_cast<MetaPageData*>(meta->data + sizeof(PageHeader));
+        mp->free_list_head = INVALID_PAGE_ID;
+        mp->free_page_count = 0;
+        mp->page_size = T::PAGE;
+        meta.markDirty();
+        meta.release();
 
-        mp->root_page_id = root_page_id;
+        root_page_id = dm->allocatePage();
+        PageGuard root = dm->newPage(root_page_id);
+        initPage(root.get(), root_page_id, PAGE_LEAF, 0);
+        root.release();
 
-        mp->total_pages_allocated = 2;
+        MiniTxn mtx;
+        updateRoot(mtx, root_page_id);
+        dm->commit(mtx);
+        mtx.releasePages();
 
         dm->sync();
 
@@ -35,394 +44,1136 @@ BPlusTree::BPlusTree() {
 }
 
 
-BPlusTree::~BPlusTree() {
+template <typename T>
+BasicBPlusTree<T>::~BasicBPlusTree() {
 
     if (dm) delete dm;
 
 }
 
 
-void BPlusTree::flush() { dm->sync(); }
+template <typename T>
+void BasicBPlusTree<T>::flush() { dm->sync(); }
 
 
-void BPlusTree::initPage(Page* p, int id, int parent, int type) {
-    std::memset(p->data, 0, PAGE_SIZE);
+template <typename T>
+void BasicBPlusTree<T>::initPage(Page* p, PageId id, int type, int level) {
+    std::memset(p->data, 0, T::PAGE);
     PageHeader* h = p->getHeader();
 
     h->page_id = id;
-    h->parent_id = parent;
 
     h->page_type = type;
+    h->level = level;
 
     h->num_items = 0;
 
-    h->next_leaf = INVALID_PAGE_ID;
+    h->right_link = INVALID_PAGE_ID;
     h->extra_ptr = INVALID_PAGE_ID;
 
+    if (type == PAGE_LEAF) LeafNode(p).init();
 }
 
-char* BPlusTree::find(int key) {
+template <typename T>
+char* BasicBPlusTree<T>::find(const Key& key) {
 
-    int leaf_id = findLeaf(key);
+    char* result = (char*)malloc(T::VALUE_SIZE);
 
-    Page* leaf = dm->getPage(leaf_id);
+    if (!findInto(key, result)) {
+        free(result);
+        return nullptr;
+    }
+    return result;
+}
 
-    if (!leaf) return nullptr;
 
+template <typename T>
+bool BasicBPlusTree<T>::findInto(const Key& key, char* out) {
 
-    PageHeader* h = leaf->getHeader();
-    LeafEntry* entries = reinterpret_cast<LeafEntry*>(leaf->data + sizeof(PageHeader));
+    EpochGuard epoch;
+    int found = findOptimistic(key, out);
+    if (found >= 0) return found == 1;
 
+    PageGuard leaf = findLeaf(key, LATCH_SHARED);
 
-    int l = 0, r = h->num_items - 1;
-    while (l <= r) {
+    if (!leaf) return false;
 
-        int mid = l + (r - l) / 2;
-        if (entries[mid].key == key) {
-            char* result = (char*)malloc(TUPLE_SIZE);
+    LeafNode node(leaf.get());
+    int slot = node.find(key);
+    if (slot < 0) return false;
 
-            std::memcpy(result, entries[mid].data, TUPLE_SIZE);
+    node.copyValue(slot, out);
+    return true;
+}
 
-            return result;
 
-        }
-        if (entries[mid].key < key) l = mid + 1;
+template <typename T>
+static TupleView leafView(const BasicLeafNode<T>& node, PageGuard&& leaf, int slot) {
+    return TupleView(std::move(leaf), node.value(slot));
+}
 
-        else r = mid - 1;
-    }
-    return nullptr;
 
+template <typename T>
+static TupleView leafView(const PackedLeafNode<T>& node, PageGuard&&, int slot) {
+    char* copy = (char*)malloc(T::VALUE_SIZE);
+    node.copyValue(slot, copy);
+    return TupleView(copy);
 }
 
 
+template <typename T>
+TupleView BasicBPlusTree<T>::view(const Key& key) {
 
-int BPlusTree::findLeaf(int key) {
+    EpochGuard epoch;
+    PageGuard leaf = findLeaf(key, LATCH_SHARED);
 
-    int curr = root_page_id;
-    while(true) {
-        Page* p = dm->getPage(curr);
+    if (!leaf) return TupleView();
 
-        PageHeader* h = p->getHeader();
+    LeafNode node(leaf.get());
+    int slot = node.find(key);
+    if (slot < 0) return TupleView();
+
+    return leafView(node, std::move(leaf), slot);
+}
+
+
+// Descends to the node at `level` whose key range holds key and latches it in mode. A child is
+// latched only after its parent is released, so by then a split may have handed the key to a right
+// sibling, reached through the right link, or a merge may have freed the node, which sends the
+// descent back to the root. Right links a writer follows belong to splits whose separator may not be
+// in the parent yet; they are added to posts. Returns an empty guard when the tree is lower than level.
+template <typename T>
+PageGuard BasicBPlusTree<T>::findNode(const Key& key, int level, LatchMode mode, bool strict, std::vector<SplitPost>* posts) {
 
-        if (h->page_type == PAGE_LEAF) return curr;
+    while (true) {
+        root_latch.lockShared();
+        PageGuard curr = dm->getPage(root_page_id, LATCH_SHARED);
+        int expect = curr->getHeader()->level;
+
+        if (expect < level) {
+            curr.release();
+            root_latch.unlock();
+            return PageGuard();
+        }
+        if (expect == level && mode != LATCH_SHARED) {
+            curr.release();
+            curr = dm->getPage(root_page_id, mode);
+        }
+        root_latch.unlock();
+
+        while (true) {
+            PageHeader* h = curr->getHeader();
+            NodeFences<T> f(curr.get());
+
+            bool live = (h->page_type == PAGE_LEAF || h->page_type == PAGE_INTERNAL) && h->level == expect;
+            if (!live || !f.aboveLow(key, strict)) break;
+
+            if (!f.belowHigh(key, strict)) {
+                PageId right = h->right_link;
+                if (posts) {
+                    SplitPost post = { expect, f.high(), right };
+                    posts->push_back(post);
+                }
+                curr.release();
+                curr = dm->getPage(right, expect == level ? mode : LATCH_SHARED);
+                continue;
+            }
 
-        InternalEntry* entries = reinterpret_cast<InternalEntry*>(p->data + sizeof(PageHeader));
-        
-        int bl = 0, br = h->num_items - 1;
-        int idx = -1;
-        int child = h->extra_ptr;
+            if (expect == level) return curr;
 
-        while(bl <= br) {
+            InternalNode node(curr.get());
+            int idx = strict ? node.lowerBound(key) - 1 : childIndex(curr.get(), key);
+            PageId child = childAt(curr.get(), idx + 1);
 
-            int mid = bl + (br - bl) / 2;
-            if (entries[mid].key <= key) {
+            curr.release();
+            expect--;
+            curr = dm->getPage(child, expect == level ? mode : LATCH_SHARED);
+        }
+    }
+}
 
-                idx = mid;
 
-                bl = mid + 1;
-            } else {
-                br = mid - 1;
+// Point lookup that takes no latch, pin or pool mutex, so readers of the same hot pages do not
+// write to shared cache lines. Each node is used only if its frame's version is the same before
+// and after it was read, and is then checked against key through its type, level and fences as in
+// findNode, so a parent and its child need not be validated together. Nothing read from a node is
+// trusted before validation, which is why counts are range-checked before a search and packed
+// leaves are decoded from a validated copy. Returns 1 or 0 for found or not, or -1 when a page is
+// not cached or writers kept changing the nodes, leaving the lookup to the latched descent.
+template <typename T>
+int BasicBPlusTree<T>::findOptimistic(const Key& key, char* out) {
+    alignas(8) char copy[T::PACKED_LEAVES ? T::PAGE : 1];
+    char val[T::VALUE_SIZE] = {};
+
+    PageId id = root_page_id;
+    int expect = -1;
+
+    for (int retries = 0; retries < OPTIMISTIC_READ_RETRIES; ) {
+        OptimisticRead r;
+        if (!dm->readOptimistic(id, r)) {
+            if (r.frame < 0) return -1;
+            retries++;
+            continue;
+        }
 
+        Page* p = r.page;
+        PageHeader* h = p->getHeader();
+        int level = h->level;
+        bool live = (h->page_type == PAGE_LEAF ? level == 0 : h->page_type == PAGE_INTERNAL && level > 0) && (expect < 0 || level == expect);
+
+        if (live && level == 0 && T::PACKED_LEAVES) {
+            std::memcpy(copy, p->data, T::PAGE);
+            if (!dm->validate(r)) {
+                retries++;
+                continue;
             }
+            p = reinterpret_cast<Page*>(copy);
+            h = p->getHeader();
         }
 
+        NodeFences<T> f(p);
+        int n = h->num_items;
+        bool sane = n >= 0 && n <= (level > 0 ? T::INTERNAL_CAPACITY : T::LEAF_MAX_ITEMS) && h->unsorted_items >= 0 && h->unsorted_items <= n;
+        bool covers = live && sane && f.aboveLow(key);
+        bool right = covers && !f.belowHigh(key);
+        PageId next = right ? h->right_link : INVALID_PAGE_ID;
+        int slot = -1;
+
+        if (covers && !right && level > 0) next = childAt(p, childIndex(p, key) + 1);
+        if (covers && !right && level == 0) {
+            LeafNode node(p);
+            slot = node.find(key);
+            if (slot >= 0) node.copyValue(slot, val);
+        }
+
+        if (!dm->validate(r)) {
+            retries++;
+            continue;
+        }
 
+        if (!covers) {
+            id = root_page_id;
+            expect = -1;
+            retries++;
+            continue;
+        }
+
+        expect = right ? level : level - 1;
+        if (right || level > 0) {
+            id = next;
+            continue;
+        }
 
-        if (idx != -1) child = entries[idx].ptr;
-        curr = child;
+        if (slot < 0) return 0;
+        std::memcpy(out, val, T::VALUE_SIZE);
+        return 1;
     }
+    return -1;
+}
+
+
+template <typename T>
+bool BasicBPlusTree<T>::isSafe(Page* p, bool is_root) {
+    PageHeader* h = p->getHeader();
+    bool leaf = h->level == 0;
+
+    if (is_root) return leaf || h->num_items > 1;
+
+    return leaf ? !LeafNode(p).atMinimum() : h->num_items > T::MIN_INTERNAL_ITEMS;
 }
 
 
-bool BPlusTree::insert(int key, const char* val) {
+// Latches the path a rebalancing removal may change, under smo_latch held exclusively. A node whose
+// split was never posted (the post is lost if the process stops in between) is passed through its
+// right link; such a node is not a child of the latched parent and is left underfull.
+template <typename T>
+void BasicBPlusTree<T>::lockPath(const Key& key, WritePath& path) {
 
-    int leaf_id = findLeaf(key);
-    Page* leaf = dm->getPage(leaf_id);
+    root_latch.lockExclusive();
+    path.root_latch = &root_latch;
 
-    PageHeader* h = leaf->getHeader();
+    PageGuard node = dm->getPage(root_page_id, LATCH_EXCLUSIVE);
 
-    LeafEntry* entries = reinterpret_cast<LeafEntry*>(leaf->data + sizeof(PageHeader));
+    while (true) {
+        while (!NodeFences<T>(node.get()).belowHigh(key)) node = dm->getPage(node->getHeader()->right_link, LATCH_EXCLUSIVE);
 
+        if (isSafe(node.get(), node->getHeader()->page_id == root_page_id)) path.release();
+        path.nodes.push_back(std::move(node));
 
-    for(int i=0; i<h->num_items; i++) {
-        if (entries[i].key == key) return false;
+        Page* p = path.nodes.back().get();
+        if (p->getHeader()->level == 0) return;
+
+        node = dm->getPage(childAt(p, childIndex(p, key) + 1), LATCH_EXCLUSIVE);
     }
+}
 
 
+template <typename T>
+int BasicBPlusTree<T>::insertIntoLeaf(MiniTxn& mtx, PageGuard& leaf, const Key& key, const char* val) {
 
-    if (h->num_items < LEAF_CAPACITY) {
+    LeafNode node(leaf.get());
 
-        int idx = 0;
-        while(idx < h->num_items && entries[idx].key < key) idx++;
+    if (node.find(key) >= 0) return 0;
 
-        
-        if (idx < h->num_items) {
+    if (!node.insert(key, val)) return -1;
 
-            std::memmove(&entries[idx+1], &entries[idx], (h->num_items - idx) * sizeof(LeafEntry));
-        }
+    leaf.markDirty();
+    logLeafInsert(mtx, leaf.get(), key, val);
+    return 1;
+}
 
-        entries[idx].key = key;
-        std::memcpy(entries[idx].data, val, TUPLE_SIZE);
 
-        h->num_items++;
-        return true;
+// A full leaf is split in place: the new right sibling is linked in and committed before its
+// separator reaches the parent, which finish() posts afterwards in mini-transactions of their own.
+template <typename T>
+bool BasicBPlusTree<T>::insert(const Key& key, const char* val) {
 
-    }
+    EpochGuard epoch;
+    std::vector<SplitPost> posts;
+    WritePath path;
+    smo_latch.lockShared();
+    path.nodes.push_back(findNode(key, 0, LATCH_EXCLUSIVE, false, &posts));
 
+    int res = insertIntoLeaf(path.mtx, path.nodes.back(), key, val);
 
+    if (res < 0) insertSplitLeaf(path, key, val, posts);
 
-    insertSplitLeaf(leaf_id, leaf, key, val);
-    return true;
+    finish(path, &posts);
+    smo_latch.unlock();
+    return res != 0;
 
 }
 
 
-void BPlusTree::insertSplitLeaf(int old_id, Page* old_leaf, int key, const char* val) {
+template <typename T>
+void BasicBPlusTree<T>::insertSplitLeaf(WritePath& path, const Key& key, const char* val, std::vector<SplitPost>& posts) {
+    PageGuard& old_leaf = path.nodes.back();
     PageHeader* old_h = old_leaf->getHeader();
-    LeafEntry* old_entries = reinterpret_cast<LeafEntry*>(old_leaf->data + sizeof(PageHeader));
+    LeafNode old_node(old_leaf.get());
+    old_node.normalize();
 
-    std::vector<LeafEntry> buffer(LEAF_CAPACITY + 1);
-    std::memcpy(buffer.data(), old_entries, old_h->num_items * sizeof(LeafEntry));
+    std::vector<LeafEntry> buffer(T::LEAF_MAX_ITEMS + 1);
+    for(int i=0; i<old_h->num_items; i++) buffer[i] = old_node.entry(i);
 
 
 
-    int idx = 0;
+    int idx = old_node.lowerBound(key);
 
-    while(idx < old_h->num_items && buffer[idx].key < key) idx++;
 
-    
     for(int i=old_h->num_items; i>idx; i--) buffer[i] = buffer[i-1];
     buffer[idx].key = key;
-    std::memcpy(buffer[idx].data, val, TUPLE_SIZE);
+    std::memcpy(buffer[idx].data, val, T::VALUE_SIZE);
 
-    int new_id = dm->allocatePage();
+    PageId new_id = dm->allocatePage();
 
-    Page* new_leaf = dm->getPage(new_id);
-    initPage(new_leaf, new_id, old_h->parent_id, PAGE_LEAF);
+    PageGuard new_leaf = dm->newPage(new_id);
+    initPage(new_leaf.get(), new_id, PAGE_LEAF, 0);
 
-    PageHeader* new_h = new_leaf->getHeader();
-
-    LeafEntry* new_entries = reinterpret_cast<LeafEntry*>(new_leaf->data + sizeof(PageHeader));
+    LeafNode new_node(new_leaf.get());
 
     int total = old_h->num_items + 1;
 
-    int mid = total / 2;
+    int mid = LeafNode::splitPoint(buffer.data(), total);
 
-    old_h->num_items = mid;
-    std::memcpy(old_entries, buffer.data(), mid * sizeof(LeafEntry));
+    old_node.assign(buffer.data(), mid);
 
 
     int new_count = total - mid;
-    new_h->num_items = new_count;
-    std::memcpy(new_entries, &buffer[mid], new_count * sizeof(LeafEntry));
+    new_node.assign(&buffer[mid], new_count);
+
+    Key sep = buffer[mid].key;
+    NodeFences<T> old_f(old_leaf.get());
+    NodeFences<T> new_f(new_leaf.get());
+    new_f.takeHigh(old_f);
+    new_f.setLow(sep);
+    old_f.setHigh(sep, new_id);
 
-    new_h->next_leaf = old_h->next_leaf;
+    old_leaf.markDirty();
+    logLeafSplit(path.mtx, old_leaf.get(), key, val, mid, sep, new_id);
+    path.mtx.logImage(new_leaf.get());
 
-    old_h->next_leaf = new_id;
+    path.mtx.hold(std::move(new_leaf));
+    path.retire();
 
-    insertIntoParent(old_id, new_entries[0].key, new_id);
+    SplitPost post = { 0, sep, new_id };
+    posts.push_back(post);
 
 }
 
-void BPlusTree::insertIntoParent(int left_id, int key, int right_id) {
+template <typename T>
+void BasicBPlusTree<T>::insertSplitInternal(WritePath& path, const Key& key, PageId right_id, std::vector<SplitPost>& posts) {
+    PageGuard& old_node = path.nodes.back();
+    PageHeader* old_h = old_node->getHeader();
 
-    Page* left = dm->getPage(left_id);
+    InternalNode old_n(old_node.get());
 
-    int parent_id = left->getHeader()->parent_id;
+    std::vector<InternalEntry> buffer(T::INTERNAL_CAPACITY + 1);
 
-    if (parent_id == INVALID_PAGE_ID) {
-        int new_root_id = dm->allocatePage();
+    for(int i=0; i<old_h->num_items; i++) buffer[i] = old_n.entry(i);
 
-        Page* root = dm->getPage(new_root_id);
 
-        initPage(root, new_root_id, INVALID_PAGE_ID, PAGE_INTERNAL);
 
-        
-        PageHeader* rh = root->getHeader();
-        InternalEntry* re = reinterpret_cast<InternalEntry*>(root->data + sizeof(PageHeader));
+    int idx = old_n.lowerBound(key);
 
+    for(int i=old_h->num_items; i>idx; i--) buffer[i] = buffer[i-1];
+    buffer[idx].key = key;
 
-        rh->extra_ptr = left_id;
-        re[0].key = key;
-        re[0].ptr = right_id;
+    buffer[idx].ptr = right_id;
 
-        rh->num_items = 1;
 
+    PageId new_id = dm->allocatePage();
 
-        left->getHeader()->parent_id = new_root_id;
+    PageGuard new_node = dm->newPage(new_id);
+    initPage(new_node.get(), new_id, PAGE_INTERNAL, old_h->level);
 
-        dm->getPage(right_id)->getHeader()->parent_id = new_root_id;
-        updateRoot(new_root_id);
+    PageHeader* new_h = new_node->getHeader();
+    InternalNode new_n(new_node.get());
 
-        return;
 
-    }
+    int total = old_h->num_items + 1;
+    int mid = total / 2;
 
+    Key up_key = buffer[mid].key;
 
-    Page* parent = dm->getPage(parent_id);
-    PageHeader* ph = parent->getHeader();
+
+    old_n.assign(buffer.data(), mid);
 
 
-    if (ph->num_items < INTERNAL_CAPACITY) {
-        InternalEntry* pe = reinterpret_cast<InternalEntry*>(parent->data + sizeof(PageHeader));
+    new_h->extra_ptr = buffer[mid].ptr;
+
 
-        int idx = 0;
-        while(idx < ph->num_items && pe[idx].key < key) idx++;
+    int new_count = total - (mid + 1);
+    new_n.assign(&buffer[mid + 1], new_count);
 
+    NodeFences<T> old_f(old_node.get());
+    NodeFences<T> new_f(new_node.get());
+    new_f.takeHigh(old_f);
+    new_f.setLow(up_key);
+    old_f.setHigh(up_key, new_id);
 
+    old_node.markDirty();
+    logInternalSplit(path.mtx, old_node.get(), key, right_id, mid, up_key, new_id);
+    path.mtx.logImage(new_node.get());
 
-        if (idx < ph->num_items) {
-            std::memmove(&pe[idx+1], &pe[idx], (ph->num_items - idx) * sizeof(InternalEntry));
+    SplitPost post = { old_h->level, up_key, new_id };
+    path.mtx.hold(std::move(new_node));
+    path.retire();
+
+    posts.push_back(post);
+
+}
+
+
+// Adds the separator of a committed split to the level above, growing a new root when the split
+// node is the root. Another writer may have posted it already, in which case nothing changes.
+// Returns the LSN of the change.
+template <typename T>
+long long BasicBPlusTree<T>::postSplit(const SplitPost& s, std::vector<SplitPost>& posts) {
+
+    WritePath path;
+    PageGuard parent = findNode(s.sep, s.level + 1, LATCH_EXCLUSIVE, false, &posts);
+
+    if (!parent) {
+        root_latch.lockExclusive();
+        path.root_latch = &root_latch;
+
+        PageGuard old_root = dm->getPage(root_page_id, LATCH_SHARED);
+        bool grown = old_root->getHeader()->level > s.level;
+        old_root.release();
+        if (grown) {
+            path.release();
+            return postSplit(s, posts);
         }
 
-        pe[idx].key = key;
-        pe[idx].ptr = right_id;
-        ph->num_items++;
+        PageId new_root_id = dm->allocatePage();
+
+        PageGuard root = dm->newPage(new_root_id);
+
+        initPage(root.get(), new_root_id, PAGE_INTERNAL, s.level + 1);
+
+        root->getHeader()->extra_ptr = root_page_id;
+        InternalNode(root.get()).insertAt(0, s.sep, s.right);
+
+        path.mtx.logImage(root.get());
+        path.mtx.hold(std::move(root));
+
+        updateRoot(path.mtx, new_root_id);
+        return commit(path);
+    }
+
+    InternalNode pn(parent.get());
+    int idx = childIndex(parent.get(), s.sep);
+    if (idx >= 0 && T::equal(pn.key(idx), s.sep)) return 0;
+
+    path.nodes.push_back(std::move(parent));
+
+    if (pn.size() < T::INTERNAL_CAPACITY) {
+        pn.insertAt(idx + 1, s.sep, s.right);
+        path.nodes.back().markDirty();
+        logInternalInsert(path.mtx, path.nodes.back().get(), s.sep, s.right);
     } else {
 
-        insertSplitInternal(parent_id, parent, key, right_id);
+        insertSplitInternal(path, s.sep, s.right, posts);
     }
 
+    return commit(path);
 }
 
-void BPlusTree::insertSplitInternal(int old_id, Page* old_node, int key, int right_id) {
-    PageHeader* old_h = old_node->getHeader();
 
-    InternalEntry* old_entries = reinterpret_cast<InternalEntry*>(old_node->data + sizeof(PageHeader));
+template <typename T>
+void BasicBPlusTree<T>::updateRoot(MiniTxn& mtx, PageId new_root) {
+    root_page_id = new_root;
+    PageGuard meta = dm->getPage(0, LATCH_EXCLUSIVE);
 
-    std::vector<InternalEntry> buffer(INTERNAL_CAPACITY + 1);
+    MetaPageData* mp = reinterpret_cast<MetaPageData*>(meta->data + sizeof(PageHeader));
 
-    std::memcpy(buffer.data(), old_entries, old_h->num_items * sizeof(InternalEntry));
+    mp->root_page_id = root_page_id;
+    meta.markDirty();
+    mtx.logBytes(meta.get(), sizeof(PageHeader), sizeof(MetaPageData));
+    mtx.hold(std::move(meta));
+}
 
 
+template <typename T>
+long long BasicBPlusTree<T>::commit(WritePath& path) {
+    dm->commit(path.mtx);
 
-    int idx = 0;
-    while(idx < old_h->num_items && buffer[idx].key < key) idx++;
-    
-    for(int i=old_h->num_items; i>idx; i--) buffer[i] = buffer[i-1];
-    buffer[idx].key = key;
+    long long lsn = path.mtx.lsn();
+    std::vector<PageId> freed = path.mtx.freedPages();
+    path.release();
 
-    buffer[idx].ptr = right_id;
+    for (size_t i = 0; i < freed.size(); i++) dm->deallocatePage(freed[i]);
+    return lsn;
+}
 
 
-    int new_id = dm->allocatePage();
+// Commits the write, then posts the separators of the splits it made or passed. Each post commits
+// on its own; the write is acknowledged once the last of them is durable.
+template <typename T>
+void BasicBPlusTree<T>::finish(WritePath& path, std::vector<SplitPost>* posts) {
+    long long lsn = commit(path);
 
-    Page* new_node = dm->getPage(new_id);
-    initPage(new_node, new_id, old_h->parent_id, PAGE_INTERNAL);
+    while (posts && !posts->empty()) {
+        SplitPost s = posts->back();
+        posts->pop_back();
+        lsn = std::max(lsn, postSplit(s, *posts));
+    }
 
-    PageHeader* new_h = new_node->getHeader();
-    InternalEntry* new_entries = reinterpret_cast<InternalEntry*>(new_node->data + sizeof(PageHeader));
+    if (lsn > 0) dm->waitDurable(lsn);
+}
 
 
-    int total = old_h->num_items + 1;
-    int mid = total / 2;
+template <typename T>
+int BasicBPlusTree<T>::removeFromLeaf(MiniTxn& mtx, PageGuard& leaf, const Key& key, bool allow_underflow) {
 
-    int up_key = buffer[mid].key;
+    LeafNode node(leaf.get());
 
 
-    old_h->num_items = mid;
-    std::memcpy(old_entries, buffer.data(), mid * sizeof(InternalEntry));
+    int idx = node.find(key);
 
+    if (idx == -1) return 0;
 
-    new_h->extra_ptr = buffer[mid].ptr;
+    if (!allow_underflow && node.atMinimum()) return -1;
 
+    node.removeAt(idx);
+    leaf.markDirty();
+    logLeafDelete(mtx, leaf.get(), key);
+    return 1;
+}
 
-    int new_count = total - (mid + 1);
-    new_h->num_items = new_count;
 
-    if (new_count > 0) {
-        std::memcpy(new_entries, &buffer[mid + 1], new_count * sizeof(InternalEntry));
+template <typename T>
+bool BasicBPlusTree<T>::remove(const Key& key) {
+
+    EpochGuard epoch;
+    {
+        std::vector<SplitPost> posts;
+        WritePath path;
+        smo_latch.lockShared();
+        path.nodes.push_back(findNode(key, 0, LATCH_EXCLUSIVE, false, &posts));
+
+        int res = removeFromLeaf(path.mtx, path.nodes.back(), key, false);
+        finish(path, &posts);
+        smo_latch.unlock();
+        if (res >= 0) return res == 1;
     }
 
 
+    int res;
+    smo_latch.lockExclusive();
+    {
+        WritePath path;
+        lockPath(key, path);
+
+        PageGuard left;
+        bool underflow = LeafNode(path.nodes.back().get()).atMinimum() && path.nodes.size() > 1;
+        if (underflow) left = lockLeftSibling(path, childIndex(path.nodes[path.nodes.size() - 2].get(), key) + 1);
 
-    Page* childP0 = dm->getPage(new_h->extra_ptr);
-    if(childP0) childP0->getHeader()->parent_id = new_id;
+        res = removeFromLeaf(path.mtx, path.nodes.back(), key, true);
 
-    for(int i=0; i<new_count; i++) {
+        if (res == 1 && underflow) rebalanceLeaf(path, key, left);
 
-        Page* child = dm->getPage(new_entries[i].ptr);
-        if(child) child->getHeader()->parent_id = new_id;
+        left.release();
+        finish(path);
     }
+    smo_latch.unlock();
+    return res == 1;
+}
+
 
-    insertIntoParent(old_id, up_key, new_id);
+template <typename T>
+std::vector<int> BasicBPlusTree<T>::batchOrder(const Key* keys, int n) {
+    std::vector<int> order(n);
+    for (int i = 0; i < n; i++) order[i] = i;
 
+    std::stable_sort(order.begin(), order.end(), [keys](int a, int b) { return T::less(keys[a], keys[b]); });
+    return order;
 }
 
 
-void BPlusTree::updateRoot(int new_root) {
-    root_page_id = new_root;
-    Page* meta = dm->getPage(0);
+template <typename T>
+void BasicBPlusTree<T>::startLane(BatchLane& lane, int i, int end) {
+    lane.next_id = INVALID_PAGE_ID;
+    lane.next_level = -1;
+    lane.i = i;
+    lane.end = end;
+    lane.prefetched = 0;
+}
 
-    MetaPageData* mp = reinterpret_cast<MetaPageData*>(meta->data + sizeof(PageHeader));
 
-    mp->root_page_id = root_page_id;
+// Moves lane one stage toward the leaf for its next key. Returns true once that leaf is latched.
+// Each level takes two steps: fetching the node and prefetching its first lines, then searching it,
+// prefetching the pool slot of the chosen child and releasing the node. Whatever a step prefetches
+// is only touched on the lane's next step, so the caller runs the other lanes while those lines
+// arrive. A lane holds at most one latch, and waits for one only when wait is set, which the caller
+// allows once no other lane holds any; a busy node is otherwise tried again on a later step. As in
+// findNode, a node split since it was chosen is left for its right link and one freed or narrowed
+// sends the lane back to the root.
+template <typename T>
+bool BasicBPlusTree<T>::stepLane(BatchLane& lane, const Key* keys, const int* order, LatchMode leaf_mode, bool wait) {
+    const Key& key = keys[order[lane.i]];
+
+    if (!lane.node) {
+        PageId id = lane.next_id;
+        if (id == INVALID_PAGE_ID) {
+            if (wait) root_latch.lockShared();
+            else if (!root_latch.tryLockShared()) return false;
+            id = root_page_id;
+            root_latch.unlock();
+        }
+
+        lane.node = dm->getPage(id, lane.next_level == 0 ? leaf_mode : LATCH_SHARED, wait);
+        if (!lane.node) return false;
+
+        lane.next_id = id;
+        if (lane.next_level == 0) LeafNode(lane.node.get()).prefetch();
+        else InternalNode(lane.node.get()).prefetch();
+        return false;
+    }
+
+    Page* p = lane.node.get();
+    PageHeader* h = p->getHeader();
+    NodeFences<T> f(p);
+
+    bool live = (h->page_type == PAGE_LEAF || h->page_type == PAGE_INTERNAL) && (lane.next_level < 0 || h->level == lane.next_level);
+    if (!live || !f.aboveLow(key)) {
+        lane.node.release();
+        lane.path.clear();
+        lane.next_id = INVALID_PAGE_ID;
+        lane.next_level = -1;
+        return false;
+    }
+
+    if (!f.belowHigh(key)) {
+        lane.next_id = h->right_link;
+        lane.next_level = h->level;
+        lane.node.release();
+        return false;
+    }
+
+    if (h->level == 0) {
+        if (lane.next_level == 0 || leaf_mode == LATCH_SHARED) return true;
+
+        // The root turned out to be a leaf, latched shared; fetch it again in the leaf mode.
+        lane.next_level = 0;
+        lane.node.release();
+        return false;
+    }
+
+    BatchLevel level = { h->page_id, h->level, f.high(), f.hasHigh() };
+    lane.path.push_back(level);
+
+    int idx = childIndex(p, key);
+    if (h->level == 1) prefetchLeaves(p, keys, order, lane);
+
+    lane.next_id = childAt(p, idx + 1);
+    lane.next_level = h->level - 1;
+    lane.node.release();
+    dm->prefetchSlot(lane.next_id);
+    return false;
 }
 
 
-bool BPlusTree::remove(int key) {
-    int leaf_id = findLeaf(key);
+// Releases the leaf of a lane and points it at the lowest node it passed that still covers its next
+// key, or at the root.
+template <typename T>
+void BasicBPlusTree<T>::resumeLane(BatchLane& lane, const Key* keys, const int* order) {
+    lane.node.release();
+    if (lane.i == lane.end) return;
 
-    Page* leaf = dm->getPage(leaf_id);
+    const Key& key = keys[order[lane.i]];
+    while (!lane.path.empty() && !lane.path.back().covers(key)) lane.path.pop_back();
 
-    PageHeader* h = leaf->getHeader();
-    LeafEntry* entries = reinterpret_cast<LeafEntry*>(leaf->data + sizeof(PageHeader));
+    lane.next_id = INVALID_PAGE_ID;
+    lane.next_level = -1;
+    if (lane.path.empty()) return;
 
+    lane.next_id = lane.path.back().id;
+    lane.next_level = lane.path.back().level;
+    lane.path.pop_back();
+}
+
+
+// Asks the pool for the next few leaves under p that later keys of the lane will visit, so their
+// reads overlap with the work on the current leaf. Once a hint finds its leaf already cached the lane
+// stops asking: the probe costs a pool lock, and cached leaves are prefetched by stepLane anyway.
+template <typename T>
+void BasicBPlusTree<T>::prefetchLeaves(Page* p, const Key* keys, const int* order, BatchLane& lane) {
+    InternalNode node(p);
+    NodeFences<T> fences(p);
+    int num = p->getHeader()->num_items;
+
+    int last = childIndex(p, keys[order[lane.i]]);
+    bool fenced = last + 1 < num;
+    Key fence = fenced ? node.key(last + 1) : Key();
+
+    int j = std::max(lane.prefetched, lane.i + 1);
+    for (int issued = 0; j < lane.end && issued < MULTI_PREFETCH_PAGES; j++) {
+        const Key& key = keys[order[j]];
+
+        if (!fences.belowHigh(key)) break;
+        if (fenced && T::less(key, fence)) continue;
 
-    int idx = -1;
+        int idx = childIndex(p, key);
+        fenced = idx + 1 < num;
+        if (fenced) fence = node.key(idx + 1);
 
-    for(int i=0; i<h->num_items; i++) {
-        if(entries[i].key == key) { idx = i; break; }
+        if (idx != last) {
+            if (dm->prefetch(childAt(p, idx + 1))) {
+                j = lane.end;
+                break;
+            }
+            last = idx;
+            issued++;
+        }
     }
+    lane.prefetched = j;
+    dm->startReads();
+}
 
-    if (idx == -1) return false;
 
-    if (idx < h->num_items - 1) {
+// The sorted batch is cut into up to MULTI_LOOKUP_LANES contiguous slices whose descents are
+// interleaved: each round moves every lane one step down (or answers its keys at a leaf), so the
+// cache misses of one lane's next node overlap with the searches of the others.
+template <typename T>
+int BasicBPlusTree<T>::multiGet(const Key* keys, int n, char* vals, bool* found) {
+
+    if (n <= 0) return 0;
+
+    EpochGuard epoch;
+    std::vector<int> order = batchOrder(keys, n);
+    int num_lanes = std::max(1, std::min(std::min(MULTI_LOOKUP_LANES, n), dm->poolFrames() / LANE_POOL_FRAMES));
+
+    std::vector<BatchLane> lanes(num_lanes);
+    for (int l = 0; l < num_lanes; l++) startLane(lanes[l], (long long)n * l / num_lanes, (long long)n * (l + 1) / num_lanes);
+
+    int active = num_lanes;
+    int latched = 0;
+    int hits = 0;
+
+    while (active > 0) {
+        for (int l = 0; l < num_lanes; l++) {
+            BatchLane& lane = lanes[l];
+            if (lane.i == lane.end) continue;
+
+            int held = lane.node ? 1 : 0;
+            bool at_leaf = stepLane(lane, keys, order.data(), LATCH_SHARED, latched == held);
+            latched += (lane.node ? 1 : 0) - held;
+            if (!at_leaf) continue;
+
+            LeafNode node(lane.node.get());
+            NodeFences<T> fences(lane.node.get());
+            do {
+                int k = order[lane.i];
+                int slot = node.find(keys[k]);
+
+                if (slot >= 0) {
+                    node.copyValue(slot, vals + (size_t)k * T::VALUE_SIZE);
+                    hits++;
+                }
+                if (found) found[k] = slot >= 0;
+                lane.i++;
+            } while (lane.i < lane.end && fences.belowHigh(keys[order[lane.i]]));
+
+            resumeLane(lane, keys, order.data());
+            latched--;
+            if (lane.i == lane.end) active--;
+        }
+    }
 
-        std::memmove(&entries[idx], &entries[idx+1], (h->num_items - idx - 1) * sizeof(LeafEntry));
+    return hits;
+}
+
+
+// Inserts the batch in key order. All keys that land in the same leaf go into one mini-transaction
+// and are made durable together; a key that needs a split falls back to insert(), outside the
+// structure latch that insert() takes again.
+template <typename T>
+int BasicBPlusTree<T>::multiPut(const Key* keys, const char* vals, int n) {
+
+    EpochGuard epoch;
+    std::vector<int> order = batchOrder(keys, n);
+    BatchLane lane;
+    startLane(lane, 0, n);
+    int inserted = 0;
+
+    while (lane.i < n) {
+        WritePath path;
+        smo_latch.lockShared();
+        while (!stepLane(lane, keys, order.data(), LATCH_EXCLUSIVE, true)) {}
+
+        NodeFences<T> leaf(lane.node.get());
+        path.nodes.push_back(std::move(lane.node));
+
+        int res = 0;
+        do {
+            int k = order[lane.i];
+
+            res = insertIntoLeaf(path.mtx, path.nodes.back(), keys[k], vals + (size_t)k * T::VALUE_SIZE);
+            if (res < 0) break;
+
+            inserted += res;
+            lane.i++;
+        } while (lane.i < n && leaf.belowHigh(keys[order[lane.i]]));
+
+        finish(path);
+        smo_latch.unlock();
+
+        if (res < 0) {
+            int k = order[lane.i++];
+            if (insert(keys[k], vals + (size_t)k * T::VALUE_SIZE)) inserted++;
+        }
+        resumeLane(lane, keys, order.data());
     }
-    h->num_items--;
-    return true;
+
+    return inserted;
 }
 
 
-char** BPlusTree::range(int start, int end, int& count) {
-    std::vector<char*> res;
+template <typename T>
+PageId BasicBPlusTree<T>::childAt(Page* p, int pos) {
+    if (pos == 0) return p->getHeader()->extra_ptr;
+
+    return InternalNode(p).ptr(pos - 1);
+}
 
-    int leaf_id = findLeaf(start);
-    int visited = 0;
 
+template <typename T>
+void BasicBPlusTree<T>::removeFromParent(MiniTxn& mtx, PageGuard& parent, int pos) {
+    InternalNode(parent.get()).removeAt(pos - 1);
+    parent.markDirty();
+    mtx.logImage(parent.get());
+}
 
-    while(leaf_id != INVALID_PAGE_ID && visited < 50000) {
 
-        Page* leaf = dm->getPage(leaf_id);
+// Narrows the range of left to end at sep and starts right there, for an entry moved between them.
+// Only the fence keys and the flag are logged: the item counts in the headers belong to the logged
+// insert and delete of the entry, which recovery may replay into an unsorted tail.
+template <typename T>
+void BasicBPlusTree<T>::moveFence(MiniTxn& mtx, PageGuard& left, PageGuard& right, const Key& sep) {
+    NodeFences<T>(left.get()).setHigh(sep, right->getHeader()->page_id);
+    NodeFences<T>(right.get()).setLow(sep);
 
-        PageHeader* h = leaf->getHeader();
+    mtx.logBytes(left.get(), NodeFences<T>::highOffset(), sizeof(Key));
+    mtx.logBytes(right.get(), (char*)&right->getHeader()->flags - right->data, sizeof(int));
+    mtx.logBytes(right.get(), NodeFences<T>::lowOffset(), sizeof(Key));
+}
 
-        LeafEntry* entries = reinterpret_cast<LeafEntry*>(leaf->data + sizeof(PageHeader));
 
-        for(int i=0; i<h->num_items; i++) {
+// Marks a merged node dead before it goes back to the free list, so a descent that still reaches it
+// restarts instead of reading its old range.
+template <typename T>
+void BasicBPlusTree<T>::freeNode(MiniTxn& mtx, PageGuard& node) {
+    node->getHeader()->page_type = PAGE_FREE;
+    node.markDirty();
+    mtx.logBytes(node.get(), 0, sizeof(PageHeader));
+    mtx.freePage(node->getHeader()->page_id);
+}
 
-            if (entries[i].key >= start) {
 
-                if (entries[i].key > end) goto done;
+// The left sibling is only returned while its right link is the node itself; a split of it that
+// never reached the parent leaves the two apart.
+template <typename T>
+PageGuard BasicBPlusTree<T>::lockLeftSibling(WritePath& path, int pos) {
+    if (pos == 0) return PageGuard();
 
-                char* buf = (char*)malloc(TUPLE_SIZE);
+    PageGuard& parent = path.nodes[path.nodes.size() - 2];
+    PageId node_id = path.nodes.back()->getHeader()->page_id;
+    PageId left_id = childAt(parent.get(), pos - 1);
 
-                std::memcpy(buf, entries[i].data, TUPLE_SIZE);
+    PageGuard left;
+    if (path.nodes.back()->getHeader()->level > 0) {
+        left = dm->getPage(left_id, LATCH_EXCLUSIVE);
+    } else {
+        path.nodes.back().release();
+        left = dm->getPage(left_id, LATCH_EXCLUSIVE);
+        path.nodes.back() = dm->getPage(node_id, LATCH_EXCLUSIVE);
+    }
 
-                res.push_back(buf);
+    if (left->getHeader()->right_link != node_id) left.release();
+    return left;
+}
 
-            }
+
+template <typename T>
+void BasicBPlusTree<T>::rebalanceLeaf(WritePath& path, const Key& key, PageGuard& left) {
+    PageGuard& parent = path.nodes[path.nodes.size() - 2];
+
+    PageHeader* ph = parent->getHeader();
+    InternalNode pn(parent.get());
+
+    if (ph->num_items == 0) return;
+
+    int pos = childIndex(parent.get(), key) + 1;
+
+    PageGuard& leaf = path.nodes.back();
+    if (childAt(parent.get(), pos) != leaf->getHeader()->page_id) return;
+
+    LeafNode node(leaf.get());
+    node.normalize();
+
+
+    if (left) {
+
+        LeafNode ln(left.get());
+        ln.normalize();
+
+        if (!ln.atMinimum()) {
+
+            LeafEntry e = ln.entry(ln.size() - 1);
+            node.insertAt(0, e.key, e.data);
+            ln.removeAt(ln.size() - 1);
+
+            pn.keys()[pos - 1] = e.key;
+            left.markDirty();
+            leaf.markDirty();
+            parent.markDirty();
+
+            logLeafInsert(path.mtx, leaf.get(), e.key, e.data);
+            logLeafDelete(path.mtx, left.get(), e.key);
+            moveFence(path.mtx, left, leaf, e.key);
+            path.mtx.logBytes(parent.get(), (char*)&pn.keys()[pos - 1] - parent->data, sizeof(Key));
+            path.mtx.hold(std::move(left));
+            return;
         }
+    }
+
+    PageGuard right;
+
+    if (pos < ph->num_items && childAt(parent.get(), pos + 1) == leaf->getHeader()->right_link) {
 
-        leaf_id = h->next_leaf;
-        visited++;
+        right = dm->getPage(childAt(parent.get(), pos + 1), LATCH_EXCLUSIVE);
+        LeafNode rn(right.get());
+        rn.normalize();
+
+        if (!rn.atMinimum()) {
+
+            LeafEntry e = rn.entry(0);
+            node.insertAt(node.size(), e.key, e.data);
+            rn.removeAt(0);
+
+            pn.keys()[pos] = rn.key(0);
+            right.markDirty();
+            leaf.markDirty();
+            parent.markDirty();
+
+            logLeafInsert(path.mtx, leaf.get(), e.key, e.data);
+            logLeafDelete(path.mtx, right.get(), e.key);
+            moveFence(path.mtx, leaf, right, rn.key(0));
+            path.mtx.logBytes(parent.get(), (char*)&pn.keys()[pos] - parent->data, sizeof(Key));
+            if (left) path.mtx.hold(std::move(left));
+            path.mtx.hold(std::move(right));
+            return;
+        }
     }
 
 
+    if (!left && !right) return;
+
+    int keep_pos = left ? pos - 1 : pos;
+    PageGuard& dst = left ? left : leaf;
+    PageGuard& src = left ? leaf : right;
+
+    LeafNode(dst.get()).append(LeafNode(src.get()));
+    NodeFences<T>(dst.get()).takeHigh(NodeFences<T>(src.get()));
+    dst.markDirty();
+    path.mtx.logImage(dst.get());
+    freeNode(path.mtx, src);
+
+    if (left) path.mtx.hold(std::move(left));
+    if (right) path.mtx.hold(std::move(right));
+    path.retire();
+
+    removeFromParent(path.mtx, parent, keep_pos + 1);
+
+    rebalanceInternal(path, key);
+}
+
+
+template <typename T>
+void BasicBPlusTree<T>::rebalanceInternal(WritePath& path, const Key& key) {
+    PageGuard& node = path.nodes.back();
+    PageHeader* h = node->getHeader();
+
+    if (path.nodes.size() == 1) {
+
+        if (!path.root_latch || h->page_id != root_page_id || h->num_items > 0) return;
+
+        PageId child_id = h->extra_ptr;
+        freeNode(path.mtx, node);
+        path.retire();
+
+        updateRoot(path.mtx, child_id);
+        return;
+    }
+
+    if (h->num_items >= T::MIN_INTERNAL_ITEMS) return;
+
+
+    PageGuard& parent = path.nodes[path.nodes.size() - 2];
+
+    PageHeader* ph = parent->getHeader();
+    InternalNode pn(parent.get());
+
+    if (ph->num_items == 0) return;
+
+    int pos = childIndex(parent.get(), key) + 1;
+    if (childAt(parent.get(), pos) != h->page_id) return;
+
+    PageGuard left = lockLeftSibling(path, pos);
+    PageGuard& cur = path.nodes.back();
+    h = cur->getHeader();
+    InternalNode cn(cur.get());
+
+
+    if (left) {
+
+        PageHeader* lh = left->getHeader();
+        InternalNode ln(left.get());
+
+        if (lh->num_items > T::MIN_INTERNAL_ITEMS) {
+
+            cn.insertAt(0, pn.key(pos - 1), h->extra_ptr);
+            h->extra_ptr = ln.ptr(lh->num_items - 1);
+
+            pn.keys()[pos - 1] = ln.key(lh->num_items - 1);
+            lh->num_items--;
+            NodeFences<T>(left.get()).setHigh(pn.key(pos - 1), h->page_id);
+            NodeFences<T>(cur.get()).setLow(pn.key(pos - 1));
+
+            left.markDirty();
+            cur.markDirty();
+            parent.markDirty();
+
+            path.mtx.logImage(left.get());
+            path.mtx.logImage(cur.get());
+            path.mtx.logBytes(parent.get(), (char*)&pn.keys()[pos - 1] - parent->data, sizeof(Key));
+            path.mtx.hold(std::move(left));
+            return;
+        }
+    }
+
+    PageGuard right;
+
+    if (pos < ph->num_items && childAt(parent.get(), pos + 1) == h->right_link) {
+
+        right = dm->getPage(childAt(parent.get(), pos + 1), LATCH_EXCLUSIVE);
+        PageHeader* rh = right->getHeader();
+        InternalNode rn(right.get());
+
+        if (rh->num_items > T::MIN_INTERNAL_ITEMS) {
+
+            cn.insertAt(h->num_items, pn.key(pos), rh->extra_ptr);
+
+            pn.keys()[pos] = rn.key(0);
+            rh->extra_ptr = rn.ptr(0);
+            rn.removeAt(0);
+            NodeFences<T>(cur.get()).setHigh(pn.key(pos), rh->page_id);
+            NodeFences<T>(right.get()).setLow(pn.key(pos));
+
+            right.markDirty();
+            cur.markDirty();
+            parent.markDirty();
+
+            path.mtx.logImage(right.get());
+            path.mtx.logImage(cur.get());
+            path.mtx.logBytes(parent.get(), (char*)&pn.keys()[pos] - parent->data, sizeof(Key));
+            path.mtx.hold(std::move(right));
+            return;
+        }
+    }
+
+
+    if (!left && !right) return;
+
+    int keep_pos = left ? pos - 1 : pos;
+    PageGuard& dst = left ? left : cur;
+    PageGuard& src = left ? cur : right;
+
+    PageHeader* dh = dst->getHeader();
+    PageHeader* sh = src->getHeader();
+    InternalNode dn(dst.get());
+    InternalNode sn(src.get());
+
+    int first_moved = dh->num_items;
+    dn.set(first_moved, pn.key(keep_pos), sh->extra_ptr);
+    for (int i = 0; i < sh->num_items; i++) dn.set(first_moved + 1 + i, sn.key(i), sn.ptr(i));
+    dh->num_items += sh->num_items + 1;
+    NodeFences<T>(dst.get()).takeHigh(NodeFences<T>(src.get()));
+    dst.markDirty();
+    path.mtx.logImage(dst.get());
+    freeNode(path.mtx, src);
+
+    if (left) path.mtx.hold(std::move(left));
+    if (right) path.mtx.hold(std::move(right));
+    path.retire();
+
+    removeFromParent(path.mtx, parent, keep_pos + 1);
+
+    rebalanceInternal(path, key);
+}
+
+
+template <typename T>
+int BasicBPlusTree<T>::childIndex(Page* p, const Key& key) {
+    return InternalNode(p).upperBound(key) - 1;
+}
+
+
+template <typename T>
+char** BasicBPlusTree<T>::range(const Key& start, const Key& end, int& count) {
+    std::vector<char*> res;
+
+    RangeCursor c = scan(start, end);
+    Key key;
+    char* buf = (char*)malloc(T::VALUE_SIZE);
+
+    while (c.next(key, buf)) {
+        res.push_back(buf);
+        buf = (char*)malloc(T::VALUE_SIZE);
+    }
+    free(buf);
 
-done:
 
     count = res.size();
     if (count == 0) return nullptr;
@@ -432,3 +1183,413 @@ done:
 
     return ret;
 }
+
+
+// Asks the pool for the next MULTI_PREFETCH_PAGES leaves the cursor will visit, found in the parent
+// of the leaf it resumes at, so a scan from disk has their reads in flight while it copies out the
+// current one. Only cursors past their first batch ask, and they keep the fence of the last leaf
+// asked for in ahead and ask again once they get there. A window that turns out to be cached already
+// means the range is in memory; the cursor then stops asking, as each probe costs a pool lock and
+// each window a second descent.
+template <typename T>
+void BasicBPlusTree<T>::scanAhead(RangeCursor& c) {
+    if (c.reverse ? T::less(c.ahead, c.high) : T::less(c.low, c.ahead)) return;
+
+    bool strict = c.reverse && !c.high_inclusive;
+    PageGuard parent = findNode(c.reverse ? c.high : c.low, 1, LATCH_SHARED, strict);
+    if (!parent) {
+        c.read_ahead = false;
+        return;
+    }
+
+    Page* p = parent.get();
+    InternalNode node(p);
+    int num = p->getHeader()->num_items;
+    int pos = (strict ? node.lowerBound(c.high) - 1 : childIndex(p, c.reverse ? c.high : c.low)) + 1;
+
+    int issued = 0;
+    int cached = 0;
+    for (int k = 1; k <= MULTI_PREFETCH_PAGES; k++) {
+        int q = c.reverse ? pos - k : pos + k;
+        if (q < 0 || q > num) break;
+        if (c.reverse ? !T::less(c.low, node.key(q)) : T::less(c.high, node.key(q - 1))) break;
+
+        issued++;
+        if (dm->prefetch(childAt(p, q))) cached++;
+        c.ahead = node.key(c.reverse ? q : q - 1);
+    }
+    dm->startReads();
+    if (issued > 0 && cached == issued) c.read_ahead = false;
+}
+
+
+template <typename T>
+void BasicBPlusTree<T>::scanBatch(RangeCursor& c) {
+    EpochGuard epoch;
+    bool resumed = !c.batch.empty();
+    c.batch.clear();
+    c.pos = 0;
+    if (resumed && c.read_ahead) scanAhead(c);
+
+    if (!c.reverse) {
+
+        PageGuard leaf = findLeaf(c.low, LATCH_SHARED);
+
+        while (leaf && !c.exhausted && c.batch.size() < (size_t)SCAN_BATCH_ITEMS) {
+
+            PageHeader* h = leaf->getHeader();
+            LeafNode node(leaf.get());
+
+            int order[T::LEAF_MAX_ITEMS];
+            int n = node.sortedOrder(order);
+            int i = std::partition_point(order, order + n, [&](int j) { return c.low_inclusive ? T::less(node.key(j), c.low) : !T::less(c.low, node.key(j)); }) - order;
+
+            for (; i < n && c.batch.size() < (size_t)SCAN_BATCH_ITEMS; i++) {
+                if (T::less(c.high, node.key(order[i]))) { c.exhausted = true; break; }
+                c.batch.push_back(node.entry(order[i]));
+            }
+
+            if (c.exhausted || c.batch.size() >= (size_t)SCAN_BATCH_ITEMS) break;
+
+            PageGuard next = dm->getPage(h->right_link, LATCH_SHARED);
+            leaf = std::move(next);
+        }
+
+        if (!leaf) c.exhausted = true;
+        if (!c.batch.empty()) {
+            c.low = c.batch.back().key;
+            c.low_inclusive = false;
+        }
+        return;
+    }
+
+
+    Key bound = c.high;
+    bool inclusive = c.high_inclusive;
+
+    while (!c.exhausted && c.batch.size() < (size_t)SCAN_BATCH_ITEMS) {
+
+        PageGuard leaf = findLeaf(bound, LATCH_SHARED, !inclusive);
+        LeafNode node(leaf.get());
+        NodeFences<T> f(leaf.get());
+
+        int order[T::LEAF_MAX_ITEMS];
+        int n = node.sortedOrder(order);
+        int i = std::partition_point(order, order + n, [&](int j) { return inclusive ? !T::less(bound, node.key(j)) : T::less(node.key(j), bound); }) - order - 1;
+
+        for (; i >= 0 && c.batch.size() < (size_t)SCAN_BATCH_ITEMS; i--) {
+            if (T::less(node.key(order[i]), c.low)) { c.exhausted = true; break; }
+            c.batch.push_back(node.entry(order[i]));
+        }
+
+        if (c.exhausted || c.batch.size() >= (size_t)SCAN_BATCH_ITEMS) break;
+
+        if (!f.hasLow() || !T::less(c.low, f.low())) c.exhausted = true;
+        bound = f.low();
+        inclusive = false;
+    }
+
+    if (!c.batch.empty()) {
+        c.high = c.batch.back().key;
+        c.high_inclusive = false;
+    }
+}
+
+
+template <typename T>
+bool BasicRangeCursor<T>::fill() {
+    if (exhausted || !tree) return false;
+
+    tree->scanBatch(*this);
+    return !batch.empty();
+}
+
+
+template <typename T>
+bool BasicRangeCursor<T>::next(Key& key, char* val) {
+    if (pos == batch.size() && !fill()) return false;
+
+    key = batch[pos].key;
+    if (val) std::memcpy(val, batch[pos].data, T::VALUE_SIZE);
+    pos++;
+    return true;
+}
+
+
+template <typename T>
+int BasicRangeCursor<T>::nextBatch(Key* keys, char* vals, int max) {
+    int n = 0;
+
+    while (n < max) {
+        if (pos == batch.size() && !fill()) break;
+
+        int take = std::min((int)(batch.size() - pos), max - n);
+        for (int i = 0; i < take; i++) {
+            if (keys) keys[n + i] = batch[pos + i].key;
+            if (vals) std::memcpy(vals + (size_t)(n + i) * T::VALUE_SIZE, batch[pos + i].data, T::VALUE_SIZE);
+        }
+        pos += take;
+        n += take;
+    }
+    return n;
+}
+
+
+template <typename T>
+long long BasicBPlusTree<T>::bulkLoad(BulkSource next, void* ctx, double fill_factor) {
+    root_latch.lockExclusive();
+
+    PageId old_root = root_page_id;
+    PageGuard root = dm->getPage(old_root, LATCH_SHARED);
+    bool empty = root->getHeader()->level == 0 && root->getHeader()->num_items == 0;
+    root.release();
+
+    if (!empty) {
+        root_latch.unlock();
+        return -1;
+    }
+
+    if (fill_factor > 1.0) fill_factor = 1.0;
+
+    BulkLoadState st;
+    st.internal_target = std::max(T::MIN_INTERNAL_ITEMS, (int)(T::INTERNAL_CAPACITY * fill_factor));
+
+
+    long long loaded = 0;
+    Key last_key = Key();
+    LeafEntry e;
+
+    while (next(ctx, &e.key, e.data)) {
+        if (loaded > 0 && !T::less(last_key, e.key)) continue;
+
+        last_key = e.key;
+        st.leaves.push_back(e);
+        loaded++;
+
+        if ((int)st.leaves.size() >= T::LEAF_MAX_ITEMS + T::MIN_LEAF_ITEMS) bulkEmitLeaf(st, LeafNode::fillCount(st.leaves.data(), st.leaves.size(), fill_factor), false);
+    }
+
+    if (loaded == 0) {
+        root_latch.unlock();
+        return 0;
+    }
+
+
+    while (LeafNode::fillCount(st.leaves.data(), st.leaves.size(), 1.0) < (int)st.leaves.size()) {
+        int n = std::min(LeafNode::fillCount(st.leaves.data(), st.leaves.size(), fill_factor), (int)st.leaves.size() / 2);
+        bulkEmitLeaf(st, n, false);
+    }
+    bulkEmitLeaf(st, st.leaves.size(), true);
+
+    PageId new_root = INVALID_PAGE_ID;
+    for (size_t l = 0; l < st.levels.size(); l++) {
+        int c = st.levels[l].size();
+
+        if (l == st.levels.size() - 1 && c == 1) {
+            new_root = st.levels[l][0].ptr;
+            break;
+        }
+
+        if (c - 1 > T::INTERNAL_CAPACITY) bulkEmitInternal(st, l, c / 2);
+        bulkEmitInternal(st, l, st.levels[l].size());
+    }
+
+    dm->sync();
+
+    WritePath path;
+    path.root_latch = &root_latch;
+    path.mtx.freePage(old_root);
+    updateRoot(path.mtx, new_root);
+    finish(path);
+
+    return loaded;
+}
+
+
+// Nodes of a level are written left to right, each page reserved by its left neighbour so the
+// right link can be set up front; next_ids holds the reserved page of every level.
+template <typename T>
+PageId BasicBPlusTree<T>::bulkNodeId(BulkLoadState& st, int level, bool* first) {
+    if ((int)st.next_ids.size() <= level) st.next_ids.resize(level + 1, INVALID_PAGE_ID);
+
+    *first = st.next_ids[level] == INVALID_PAGE_ID;
+    return *first ? dm->allocatePage() : st.next_ids[level];
+}
+
+
+template <typename T>
+void BasicBPlusTree<T>::bulkEmitLeaf(BulkLoadState& st, int n, bool last) {
+    bool first;
+    PageId id = bulkNodeId(st, 0, &first);
+    st.next_ids[0] = last ? INVALID_PAGE_ID : dm->allocatePage();
+
+    PageGuard leaf = dm->newPage(id);
+    initPage(leaf.get(), id, PAGE_LEAF, 0);
+
+    LeafNode(leaf.get()).assign(st.leaves.data(), n);
+    NodeFences<T> f(leaf.get());
+    if (!first) f.setLow(st.leaves[0].key);
+    if (!last) f.setHigh(st.leaves[n].key, st.next_ids[0]);
+    leaf.release();
+
+    Key first_key = st.leaves[0].key;
+    st.leaves.erase(st.leaves.begin(), st.leaves.begin() + n);
+
+    bulkPushChild(st, 0, first_key, id);
+}
+
+
+template <typename T>
+void BasicBPlusTree<T>::bulkPushChild(BulkLoadState& st, int level, const Key& key, PageId child_id) {
+    if ((int)st.levels.size() <= level) st.levels.resize(level + 1);
+
+    InternalEntry e;
+    e.key = key;
+    e.ptr = child_id;
+    st.levels[level].push_back(e);
+
+    if ((int)st.levels[level].size() >= st.internal_target + T::MIN_INTERNAL_ITEMS + 2) {
+        bulkEmitInternal(st, level, st.internal_target + 1);
+    }
+}
+
+
+template <typename T>
+void BasicBPlusTree<T>::bulkEmitInternal(BulkLoadState& st, int level, int n) {
+    std::vector<InternalEntry>& children = st.levels[level];
+    bool last = n == (int)children.size();
+
+    bool first;
+    PageId id = bulkNodeId(st, level + 1, &first);
+    st.next_ids[level + 1] = last ? INVALID_PAGE_ID : dm->allocatePage();
+
+    PageGuard node = dm->newPage(id);
+    initPage(node.get(), id, PAGE_INTERNAL, level + 1);
+
+    node->getHeader()->extra_ptr = children[0].ptr;
+    InternalNode(node.get()).assign(&children[1], n - 1);
+    NodeFences<T> f(node.get());
+    if (!first) f.setLow(children[0].key);
+    if (!last) f.setHigh(children[n].key, st.next_ids[level + 1]);
+    node.release();
+
+    Key first_key = children[0].key;
+    children.erase(children.begin(), children.begin() + n);
+
+    bulkPushChild(st, level + 1, first_key, id);
+}
+
+
+template <typename T>
+void BasicBPlusTree<T>::logLeafInsert(MiniTxn& mtx, Page* p, const Key& key, const char* val) {
+    LeafEntry e;
+    e.key = key;
+    std::memcpy(e.data, val, T::VALUE_SIZE);
+    mtx.add(p, LOG_LEAF_INSERT, &e, sizeof(e));
+}
+
+
+template <typename T>
+void BasicBPlusTree<T>::logLeafDelete(MiniTxn& mtx, Page* p, const Key& key) {
+    mtx.add(p, LOG_LEAF_DELETE, &key, sizeof(key));
+}
+
+
+template <typename T>
+void BasicBPlusTree<T>::logLeafSplit(MiniTxn& mtx, Page* p, const Key& key, const char* val, int keep, const Key& high, PageId right_link) {
+    LeafSplitLog r;
+    r.entry.key = key;
+    std::memcpy(r.entry.data, val, T::VALUE_SIZE);
+    r.keep = keep;
+    r.high = high;
+    r.right_link = right_link;
+    mtx.add(p, LOG_LEAF_SPLIT, &r, sizeof(r));
+}
+
+
+template <typename T>
+void BasicBPlusTree<T>::logInternalInsert(MiniTxn& mtx, Page* p, const Key& key, PageId ptr) {
+    InternalEntry e = { key, ptr };
+    mtx.add(p, LOG_INTERNAL_INSERT, &e, sizeof(e));
+}
+
+
+template <typename T>
+void BasicBPlusTree<T>::logInternalSplit(MiniTxn& mtx, Page* p, const Key& key, PageId ptr, int keep, const Key& high, PageId right_link) {
+    InternalSplitLog r;
+    r.entry.key = key;
+    r.entry.ptr = ptr;
+    r.keep = keep;
+    r.high = high;
+    r.right_link = right_link;
+    mtx.add(p, LOG_INTERNAL_SPLIT, &r, sizeof(r));
+}
+
+
+template <typename T>
+void BasicBPlusTree<T>::redo(Page* p, const LogEntryHeader* e, const char* data) {
+    PageHeader* h = p->getHeader();
+    LeafNode leaf(p);
+    InternalNode node(p);
+    NodeFences<T> fences(p);
+
+    switch (e->type) {
+    case LOG_LEAF_INSERT: {
+        LeafEntry r;
+        std::memcpy(&r, data, sizeof(r));
+        leaf.insert(r.key, r.data);
+        break;
+    }
+
+    case LOG_LEAF_DELETE: {
+        Key key;
+        std::memcpy(&key, data, sizeof(key));
+        int idx = leaf.find(key);
+        if (idx >= 0) leaf.removeAt(idx);
+        break;
+    }
+
+    case LOG_LEAF_SPLIT: {
+        LeafSplitLog r;
+        std::memcpy(&r, data, sizeof(r));
+        leaf.normalize();
+        int idx = leaf.lowerBound(r.entry.key);
+        if (idx < r.keep) {
+            leaf.truncate(r.keep - 1);
+            leaf.insertAt(idx, r.entry.key, r.entry.data);
+        }
+        else leaf.truncate(r.keep);
+        fences.setHigh(r.high, r.right_link);
+        break;
+    }
+
+    case LOG_INTERNAL_INSERT: {
+        InternalEntry r;
+        std::memcpy(&r, data, sizeof(r));
+        node.insertAt(node.lowerBound(r.key), r.key, r.ptr);
+        break;
+    }
+
+    case LOG_INTERNAL_SPLIT: {
+        InternalSplitLog r;
+        std::memcpy(&r, data, sizeof(r));
+        int idx = node.lowerBound(r.entry.key);
+        if (idx < r.keep) {
+            h->num_items = r.keep - 1;
+            node.insertAt(idx, r.entry.key, r.entry.ptr);
+        }
+        h->num_items = r.keep;
+        fences.setHigh(r.high, r.right_link);
+        break;
+    }
+    }
+}
+
+
+// Shapes compiled into the library. A new index shape needs its own line here.
+template class BasicBPlusTree<DefaultTreeTraits>;
+template class BasicBPlusTree<TreeTraits<KeyType, 8> >;
+template class BasicBPlusTree<TreeTraits<KeyType, TUPLE_SIZE, 16384> >;
+template class BasicRangeCursor<DefaultTreeTraits>;
+template class BasicRangeCursor<TreeTraits<KeyType, 8> >;
+template class BasicRangeCursor<TreeTraits<KeyType, TUPLE_SIZE, 16384> >;
@@ -3,33 +3,261 @@
 #define B_PLUS_TREE_H
 
 #include "DiskManager.h"
+#include "Latch.h"
+#include "Node.h"
+#include "TreeTraits.h"
 
 #include "common.h"
+#include <cstdlib>
 #include <vector>
+#include <atomic>
+
+// The nodes a write latched on its way down, root side first. Merges propagate upward through this
+// stack, as pages carry no parent pointer.
+struct WritePath {
+    std::vector<PageGuard> nodes;
+    RWLatch* root_latch;
+    MiniTxn mtx;
+
+    WritePath() : root_latch(nullptr) {}
+    ~WritePath() { release(); }
+
+    void retire() {
+        mtx.hold(std::move(nodes.back()));
+        nodes.pop_back();
+    }
+
+    void release() {
+        nodes.clear();
+        mtx.releasePages();
+        if (root_latch) root_latch->unlock();
+        root_latch = nullptr;
+    }
+};
+
+class TupleView {
+    PageGuard leaf;
+    const char* tuple;
+    char* owned;
+public:
+    TupleView() : tuple(nullptr), owned(nullptr) {}
+    TupleView(PageGuard&& leaf, const char* tuple) : leaf(std::move(leaf)), tuple(tuple), owned(nullptr) {}
+    explicit TupleView(char* copy) : tuple(copy), owned(copy) {}
+    TupleView(TupleView&& other) : leaf(std::move(other.leaf)), tuple(other.tuple), owned(other.owned) {
+        other.tuple = nullptr;
+        other.owned = nullptr;
+    }
+    ~TupleView() { free(owned); }
+
+    const char* data() const { return tuple; }
+    explicit operator bool() const { return tuple != nullptr; }
+
+    void release() {
+        leaf.release();
+        free(owned);
+        tuple = nullptr;
+        owned = nullptr;
+    }
+};
+
+template <typename T> class BasicBPlusTree;
+
+template <typename T>
+class BasicRangeCursor {
+    typedef typename T::Key Key;
+
+    BasicBPlusTree<T>* tree;
+    Key low;
+    Key high;
+    bool low_inclusive;
+    bool high_inclusive;
+    bool reverse;
+    bool exhausted;
+    bool read_ahead;
+    Key ahead;
+    std::vector<typename T::LeafEntry> batch;
+    size_t pos;
+
+    friend class BasicBPlusTree<T>;
+
+    bool fill();
+public:
+    BasicRangeCursor() : tree(nullptr), low(), high(), low_inclusive(true), high_inclusive(true), reverse(false), exhausted(true), read_ahead(false), ahead(), pos(0) {}
+    BasicRangeCursor(BasicBPlusTree<T>* tree, const Key& low, const Key& high, bool reverse)
+        : tree(tree), low(low), high(high), low_inclusive(true), high_inclusive(true), reverse(reverse), exhausted(T::less(high, low)), read_ahead(true), ahead(reverse ? high : low), pos(0) {}
+
+    bool next(Key& key, char* val);
+    int nextBatch(Key* keys, char* vals, int max);
+};
+
+// One index of a given shape. Every layout constant comes from the traits, so node search and
+// copy loops are compiled against fixed capacities and value sizes; the shapes the library
+// links are listed as explicit instantiations at the end of BPlusTree.cpp.
+template <typename T>
+class BasicBPlusTree {
+public:
+    typedef typename T::Key Key;
+    typedef typename T::LeafEntry LeafEntry;
+    typedef typename T::InternalEntry InternalEntry;
+    typedef typename LeafNodeOf<T>::type LeafNode;
+    typedef BasicInternalNode<T> InternalNode;
+    typedef BasicRangeCursor<T> RangeCursor;
+    typedef int (*BulkSource)(void* ctx, Key* key, char* val);
+
+    static const int VALUE_SIZE = T::VALUE_SIZE;
+private:
+    friend class BasicRangeCursor<T>;
+
+    struct BulkLoadState {
+        std::vector<LeafEntry> leaves;
+        std::vector<std::vector<InternalEntry> > levels;
+        int internal_target;
+        std::vector<PageId> next_ids;
+    };
+
+    struct LeafSplitLog {
+        LeafEntry entry;
+        int keep;
+        Key high;
+        PageId right_link;
+    };
+
+    struct InternalSplitLog {
+        InternalEntry entry;
+        int keep;
+        Key high;
+        PageId right_link;
+    };
+
+    // A split whose separator still has to be added to the level above: the node at `level` now
+    // ends at sep and the keys from sep on live in `right`.
+    struct SplitPost {
+        int level;
+        Key sep;
+        PageId right;
+    };
+
+    // A node a lane has passed, kept by id with the end of its key range so later keys of the lane
+    // can resume below the root. It is not latched; the node is checked again when fetched.
+    struct BatchLevel {
+        PageId id;
+        int level;
+        Key high;
+        bool bounded;
+
+        bool covers(const Key& key) const { return !bounded || T::less(key, high); }
+    };
+
+    // One descent of a batch: a slice [i, end) of the sorted keys, the nodes passed on the way down,
+    // and either the latched node it is at or the node it fetches next (next_id is INVALID_PAGE_ID
+    // for the root, next_level is -1 when the level is not known).
+    struct BatchLane {
+        std::vector<BatchLevel> path;
+        PageGuard node;
+        PageId next_id;
+        int next_level;
+        int i;
+        int end;
+        int prefetched;
+    };
 
-class BPlusTree {
     DiskManager* dm;
-    int root_page_id;
-    
-    void initPage(Page* p, int id, int parent, int type);
-    void updateRoot(int new_root);
-    int findLeaf(int key);
-
-    void insertSplitLeaf(int old_id, Page* old_leaf, int key, const char* val);
-    void insertIntoParent(int left_id, int key, int right_id);
-    void insertSplitInternal(int old_id, Page* old_node, int key, int right_id);
+    // Changed under root_latch, but read without it by optimistic lookups.
+    std::atomic<PageId> root_page_id;
+    RWLatch root_latch;
+    // Inserts and leaf-only removals hold it shared; a removal that merges or borrows takes it
+    // exclusively, so nodes are only freed or have their ranges narrowed while no split is posting.
+    RWLatch smo_latch;
+
+    void initPage(Page* p, PageId id, int type, int level);
+    void updateRoot(MiniTxn& mtx, PageId new_root);
+    long long commit(WritePath& path);
+    void finish(WritePath& path, std::vector<SplitPost>* posts = nullptr);
+    PageGuard findNode(const Key& key, int level, LatchMode mode, bool strict = false, std::vector<SplitPost>* posts = nullptr);
+    PageGuard findLeaf(const Key& key, LatchMode mode, bool strict = false) { return findNode(key, 0, mode, strict); }
+
+    int findOptimistic(const Key& key, char* out);
+
+    bool isSafe(Page* p, bool is_root);
+    void lockPath(const Key& key, WritePath& path);
+
+    int insertIntoLeaf(MiniTxn& mtx, PageGuard& leaf, const Key& key, const char* val);
+    void insertSplitLeaf(WritePath& path, const Key& key, const char* val, std::vector<SplitPost>& posts);
+    void insertSplitInternal(WritePath& path, const Key& key, PageId right_id, std::vector<SplitPost>& posts);
+    long long postSplit(const SplitPost& s, std::vector<SplitPost>& posts);
+
+    int childIndex(Page* p, const Key& key);
+    PageId childAt(Page* p, int pos);
+    void removeFromParent(MiniTxn& mtx, PageGuard& parent, int pos);
+    void moveFence(MiniTxn& mtx, PageGuard& left, PageGuard& right, const Key& sep);
+    void freeNode(MiniTxn& mtx, PageGuard& node);
+
+    int removeFromLeaf(MiniTxn& mtx, PageGuard& leaf, const Key& key, bool allow_underflow);
+    PageGuard lockLeftSibling(WritePath& path, int pos);
+    void rebalanceLeaf(WritePath& path, const Key& key, PageGuard& left);
+    void rebalanceInternal(WritePath& path, const Key& key);
+
+    void scanBatch(RangeCursor& c);
+    void scanAhead(RangeCursor& c);
+
+    std::vector<int> batchOrder(const Key* keys, int n);
+    void startLane(BatchLane& lane, int i, int end);
+    bool stepLane(BatchLane& lane, const Key* keys, const int* order, LatchMode leaf_mode, bool wait);
+    void resumeLane(BatchLane& lane, const Key* keys, const int* order);
+    void prefetchLeaves(Page* p, const Key* keys, const int* order, BatchLane& lane);
+
+    PageId bulkNodeId(BulkLoadState& st, int level, bool* first);
+    void bulkEmitLeaf(BulkLoadState& st, int n, bool last);
+    void bulkPushChild(BulkLoadState& st, int level, const Key& key, PageId child_id);
+    void bulkEmitInternal(BulkLoadState& st, int level, int n);
+
+    static void logLeafInsert(MiniTxn& mtx, Page* p, const Key& key, const char* val);
+    static void logLeafDelete(MiniTxn& mtx, Page* p, const Key& key);
+    static void logLeafSplit(MiniTxn& mtx, Page* p, const Key& key, const char* val, int keep, const Key& high, PageId right_link);
+    static void logInternalInsert(MiniTxn& mtx, Page* p, const Key& key, PageId ptr);
+    static void logInternalSplit(MiniTxn& mtx, Page* p, const Key& key, PageId ptr, int keep, const Key& high, PageId right_link);
+    static void redo(Page* p, const LogEntryHeader* e, const char* data);
 public:
 
-    BPlusTree();
+    BasicBPlusTree(int pool_frames = DEFAULT_POOL_FRAMES, const char* path = DB_FILE, const char* wal_path = WAL_FILE, BufferPool* shared_pool = nullptr);
 
-    ~BPlusTree();
+    ~BasicBPlusTree();
     void flush();
-    
-    char* find(int key);
-    bool insert(int key, const char* val);
 
-    bool remove(int key);
+    char* find(const Key& key);
+    bool findInto(const Key& key, char* out);
+    TupleView view(const Key& key);
+    bool insert(const Key& key, const char* val);
+
+    bool remove(const Key& key);
+
+    int multiGet(const Key* keys, int n, char* vals, bool* found);
+    int multiPut(const Key* keys, const char* vals, int n);
+
+    char** range(const Key& start, const Key& end, int& count);
+    RangeCursor scan(const Key& start, const Key& end, bool reverse = false) { return RangeCursor(this, start, end, reverse); }
 
-    char** range(int start, int end, int& count);
+    long long bulkLoad(BulkSource next, void* ctx, double fill_factor);
+
+    BufferPoolStats poolStats() { return dm->poolStats(); }
+    long long filePages() const { return dm->filePages(); }
+    long long freePages() { return dm->freePageCount(); }
 };
+
+template <typename T> const int BasicBPlusTree<T>::VALUE_SIZE;
+
+typedef BasicBPlusTree<DefaultTreeTraits> BPlusTree;
+typedef BasicRangeCursor<DefaultTreeTraits> RangeCursor;
+typedef BPlusTree::BulkSource BulkSource;
+
+// Shapes with a compiled fast path alongside the default one: 8-byte values and 16 KB pages.
+typedef BasicBPlusTree<TreeTraits<KeyType, 8> > SmallValueBPlusTree;
+typedef BasicBPlusTree<TreeTraits<KeyType, TUPLE_SIZE, 16384> > LargePageBPlusTree;
+
+extern template class BasicBPlusTree<DefaultTreeTraits>;
+extern template class BasicBPlusTree<TreeTraits<KeyType, 8> >;
+extern template class BasicBPlusTree<TreeTraits<KeyType, TUPLE_SIZE, 16384> >;
+extern template class BasicRangeCursor<DefaultTreeTraits>;
+extern template class BasicRangeCursor<TreeTraits<KeyType, 8> >;
+extern template class BasicRangeCursor<TreeTraits<KeyType, TUPLE_SIZE, 16384> >;
 #endif
@@ -0,0 +1,592 @@
+#include "BufferPool.h"
+#include "LogManager.h"
+#include <iostream>
+#include <unistd.h>
+#include <cstdlib>
+#include <cstdio>
+#include <fcntl.h>
+#include <cerrno>
+#include <chrono>
+
+const int MAX_USAGE = 5;
+
+PageGuard::PageGuard(PageGuard&& other) : pool(other.pool), frame_id(other.frame_id), page(other.page), mode(other.mode) {
+    other.pool = nullptr;
+    other.frame_id = -1;
+    other.page = nullptr;
+    other.mode = LATCH_NONE;
+}
+
+PageGuard& PageGuard::operator=(PageGuard&& other) {
+    if (this != &other) {
+        release();
+        pool = other.pool;
+        frame_id = other.frame_id;
+        page = other.page;
+        mode = other.mode;
+        other.pool = nullptr;
+        other.frame_id = -1;
+        other.page = nullptr;
+        other.mode = LATCH_NONE;
+    }
+    return *this;
+}
+
+void PageGuard::markDirty() {
+    if (pool) pool->frames[frame_id].dirty.store(true);
+}
+
+void PageGuard::release() {
+    if (pool) pool->unpin(frame_id, mode);
+    pool = nullptr;
+    frame_id = -1;
+    page = nullptr;
+    mode = LATCH_NONE;
+}
+
+
+BufferPool::BufferPool(int num_frames, int page_size) : num_frames(num_frames), page_size(page_size), frames(num_frames), clock_hand(0) {
+    void* mem = nullptr;
+    if (posix_memalign(&mem, page_size, (size_t)num_frames * page_size) != 0) {
+        std::cerr << "Buffer pool allocation failed" << std::endl;
+        exit(1);
+    }
+    pool_mem = static_cast<char*>(mem);
+
+    for (int i = 0; i < MAX_POOL_FILES; i++) files[i].fd = -1;
+
+    for (int i = 0; i < num_frames; i++) {
+        frames[i].file = -1;
+        frames[i].page_id = INVALID_PAGE_ID;
+        frames[i].pin_count = 0;
+        frames[i].usage = 0;
+        frames[i].dirty = false;
+        frames[i].loading = false;
+        frames[i].version = 0;
+    }
+
+    size_t slots = 1;
+    while (slots < (size_t)num_frames * 2) slots <<= 1;
+    PageSlot empty = { -1, INVALID_PAGE_ID, -1 };
+    page_table.assign(slots, empty);
+    table_mask = slots - 1;
+    st.hits = st.misses = st.evictions = st.writebacks = 0;
+
+    io = AsyncIO::create();
+    max_reads = std::min(IO_QUEUE_DEPTH, num_frames / 4);
+    reads_in_flight = 0;
+    writes_in_flight = 0;
+    stopping = false;
+    writeback_thread = std::thread(&BufferPool::writebackLoop, this);
+}
+
+BufferPool::~BufferPool() {
+    {
+        std::lock_guard<std::mutex> lk(writeback_mutex);
+        stopping = true;
+    }
+    writeback_cv.notify_all();
+    writeback_thread.join();
+
+    drainReads();
+    flushAll();
+    delete io;
+    free(pool_mem);
+}
+
+
+int BufferPool::lookup(int file, PageId page_id) const {
+    for (size_t i = homeSlot(file, page_id); ; i = (i + 1) & table_mask) {
+        const PageSlot& s = page_table[i];
+        if (s.frame < 0) return -1;
+        if (s.page_id == page_id && s.file == file) return s.frame;
+    }
+}
+
+
+void BufferPool::mapPage(int file, PageId page_id, int frame_id) {
+    size_t i = homeSlot(file, page_id);
+    while (page_table[i].frame >= 0) i = (i + 1) & table_mask;
+
+    PageSlot s = { file, page_id, frame_id };
+    page_table[i] = s;
+}
+
+
+// Backward-shift deletion: later entries of the probe run move up into the hole unless their home
+// slot lies after it, so lookups never need tombstones.
+void BufferPool::unmapPage(int file, PageId page_id) {
+    size_t i = homeSlot(file, page_id);
+    for (; page_table[i].page_id != page_id || page_table[i].file != file; i = (i + 1) & table_mask) {
+        if (page_table[i].frame < 0) return;
+    }
+
+    for (size_t j = (i + 1) & table_mask; page_table[j].frame >= 0; j = (j + 1) & table_mask) {
+        size_t home = homeSlot(page_table[j].file, page_table[j].page_id);
+        bool stays = i <= j ? (i < home && home <= j) : (i < home || home <= j);
+        if (stays) continue;
+
+        page_table[i] = page_table[j];
+        i = j;
+    }
+
+    page_table[i].file = -1;
+    page_table[i].page_id = INVALID_PAGE_ID;
+    page_table[i].frame = -1;
+}
+
+
+int BufferPool::attach(int fd, int file_page_size, LogManager* log) {
+    if (file_page_size > page_size) {
+        std::cerr << "Pages of " << file_page_size << " bytes do not fit " << page_size << "-byte buffer frames" << std::endl;
+        exit(1);
+    }
+
+    std::lock_guard<std::mutex> lk(mutex);
+    for (int i = 0; i < MAX_POOL_FILES; i++) {
+        if (files[i].fd >= 0) continue;
+
+        files[i].fd = fd;
+        files[i].page_size = file_page_size;
+        files[i].log = log;
+        return i;
+    }
+
+    std::cerr << "Buffer pool already caches " << MAX_POOL_FILES << " files" << std::endl;
+    exit(1);
+}
+
+
+void BufferPool::detach(int file) {
+    drainReads();
+    flushFrames(file);
+
+    std::lock_guard<std::mutex> wb(writeback_mutex);
+    std::lock_guard<std::mutex> lk(mutex);
+    for (int i = 0; i < num_frames; i++) {
+        Frame& f = frames[i];
+        if (f.file != file || f.page_id == INVALID_PAGE_ID) continue;
+
+        unmapPage(file, f.page_id);
+        f.file = -1;
+        f.page_id = INVALID_PAGE_ID;
+        f.usage = 0;
+    }
+    files[file].fd = -1;
+}
+
+
+// Called with lk held, for a page of file that is not cached. A dirty victim is written back with
+// the mutex released, so fetches of other pages go on meanwhile, and is evicted afterwards only if
+// nobody used it in between. Returns -1 if page_id was cached by someone else while the mutex was
+// released; the caller then looks it up again.
+int BufferPool::findVictim(std::unique_lock<std::mutex>& lk, int file, PageId page_id) {
+    for (int scanned = 0; scanned < num_frames * (MAX_USAGE + 1); scanned++) {
+        Frame& f = frames[clock_hand];
+        int id = clock_hand;
+        clock_hand = (clock_hand + 1) % num_frames;
+
+        if (f.pin_count.load() > 0) continue;
+        if (f.page_id != INVALID_PAGE_ID && f.usage > 0) {
+            f.usage--;
+            continue;
+        }
+
+        if (f.page_id != INVALID_PAGE_ID) {
+            if (f.dirty.load()) {
+                if (!writeVictim(lk, id)) continue;
+                if (lookup(file, page_id) >= 0) return -1;
+                if (f.pin_count.load() > 0 || f.usage > 0 || f.dirty.load()) continue;
+            }
+            unmapPage(f.file, f.page_id);
+            st.evictions++;
+        }
+        f.file = -1;
+        f.page_id = INVALID_PAGE_ID;
+        return id;
+    }
+
+    std::cerr << "Buffer pool exhausted: all " << num_frames << " frames pinned" << std::endl;
+    exit(1);
+}
+
+
+// Writes an unpinned dirty frame back without holding the pool mutex. The frame stays pinned, so it
+// is not evicted, and share-latched, so it is not changed while it is written.
+bool BufferPool::writeVictim(std::unique_lock<std::mutex>& lk, int frame_id) {
+    Frame& f = frames[frame_id];
+    if (!f.latch.tryLockShared()) return false;
+
+    f.pin_count.fetch_add(1);
+    lk.unlock();
+    writeFrame(frame_id);
+    f.latch.unlock();
+    lk.lock();
+    f.pin_count.fetch_sub(1);
+
+    st.writebacks++;
+    writeback_cv.notify_one();
+    return true;
+}
+
+
+void BufferPool::writeFrame(int frame_id) {
+    Frame& f = frames[frame_id];
+    const PoolFile& file = files[f.file];
+    f.dirty.store(false);
+    if (file.log) file.log->flush(framePage(frame_id)->getHeader()->lsn);
+    if (pwrite(file.fd, framePage(frame_id)->data, file.page_size, (off_t)f.page_id * file.page_size) != file.page_size) {
+        perror("Page Write Failed");
+        exit(1);
+    }
+}
+
+
+bool BufferPool::latchFrame(Frame& f, LatchMode mode, bool wait) {
+    if (wait) f.latch.lock(mode);
+    else if (!f.latch.tryLock(mode)) return false;
+
+    if (mode == LATCH_EXCLUSIVE) beginWrite(f);
+    return true;
+}
+
+
+void BufferPool::unpin(int frame_id, LatchMode mode) {
+    Frame& f = frames[frame_id];
+    if (mode == LATCH_EXCLUSIVE) endWrite(f);
+    f.latch.unlock(mode);
+    f.pin_count.fetch_sub(1);
+}
+
+
+// Without wait, an empty guard is returned instead of blocking on a latch someone else holds.
+PageGuard BufferPool::fetchPage(int file, PageId page_id, LatchMode mode, bool wait) {
+    if (page_id < 0) return PageGuard();
+
+    std::unique_lock<std::mutex> lk(mutex);
+
+    int id = lookup(file, page_id);
+    int victim = id < 0 ? findVictim(lk, file, page_id) : -1;
+    if (victim < 0) {
+        if (id < 0) id = lookup(file, page_id);
+        Frame& f = frames[id];
+        f.pin_count.fetch_add(1);
+        if (f.usage < MAX_USAGE) f.usage++;
+        st.hits++;
+        lk.unlock();
+
+        if (!waitLoaded(f, wait) || !latchFrame(f, mode, wait)) {
+            f.pin_count.fetch_sub(1);
+            return PageGuard();
+        }
+        return PageGuard(this, id, framePage(id), mode);
+    }
+
+    st.misses++;
+    id = victim;
+    Page* p = framePage(id);
+
+    Frame& f = frames[id];
+    f.latch.tryLockExclusive();
+    beginWrite(f);
+    f.file = file;
+    f.page_id = page_id;
+    f.pin_count.store(1);
+    f.usage = 1;
+    f.dirty.store(false);
+    mapPage(file, page_id, id);
+    int fd = files[file].fd;
+    int size = files[file].page_size;
+    lk.unlock();
+
+    ssize_t n = pread(fd, p->data, size, (off_t)page_id * size);
+    if (n < 0) { perror("Page Read Failed"); exit(1); }
+    if (n < size) std::memset(p->data + n, 0, size - n);
+
+    if (mode != LATCH_EXCLUSIVE) {
+        endWrite(f);
+        f.latch.unlock();
+        if (!latchFrame(f, mode, wait)) {
+            f.pin_count.fetch_sub(1);
+            return PageGuard();
+        }
+    }
+
+    return PageGuard(this, id, p, mode);
+}
+
+
+// Hint that page_id will be fetched soon: a cached page is pulled toward the CPU cache, anything
+// else is read into a frame in the background, and a fetch that arrives before the read finishes
+// waits for it instead of issuing its own. Beyond max_reads reads in flight the kernel is only
+// asked to read ahead. The reads of a window of hints are queued and started together by
+// startReads(). Returns whether the page was cached.
+bool BufferPool::prefetch(int file, PageId page_id) {
+    std::unique_lock<std::mutex> lk(mutex);
+
+    int id = lookup(file, page_id);
+    if (id >= 0) {
+        __builtin_prefetch(framePage(id)->data);
+        return true;
+    }
+
+    int fd = files[file].fd;
+    int size = files[file].page_size;
+    if (reads_in_flight.load() >= max_reads) {
+        lk.unlock();
+        posix_fadvise(fd, (off_t)page_id * size, size, POSIX_FADV_WILLNEED);
+        return false;
+    }
+
+    id = findVictim(lk, file, page_id);
+    if (id < 0) return true;
+
+    st.misses++;
+    Frame& f = frames[id];
+    beginWrite(f);
+    f.loading.store(true);
+    f.file = file;
+    f.page_id = page_id;
+    f.pin_count.store(1);
+    f.usage = 1;
+    f.dirty.store(false);
+    mapPage(file, page_id, id);
+    reads_in_flight.fetch_add(1);
+    lk.unlock();
+
+    IoRequest r = { fd, framePage(id)->data, size, (off_t)page_id * size, false, readDone, this, id };
+    io->submit(r);
+    return false;
+}
+
+
+// Runs once a background read has filled its frame: the frame becomes a cached page like any other
+// and the fetches waiting for it go on.
+void BufferPool::readDone(void* ctx, long frame_id, ssize_t res) {
+    BufferPool* pool = static_cast<BufferPool*>(ctx);
+    Frame& f = pool->frames[frame_id];
+    Page* p = pool->framePage(frame_id);
+    int size = pool->files[f.file].page_size;
+
+    if (res < 0) {
+        errno = -res;
+        perror("Page Read Failed");
+        exit(1);
+    }
+    if (res < size) std::memset(p->data + res, 0, size - res);
+
+    pool->endWrite(f);
+    {
+        std::lock_guard<std::mutex> lk(pool->io_mutex);
+        f.loading.store(false);
+        f.pin_count.fetch_sub(1);
+        pool->reads_in_flight.fetch_sub(1);
+    }
+    pool->io_cv.notify_all();
+}
+
+
+bool BufferPool::waitLoaded(Frame& f, bool wait) {
+    if (!f.loading.load(std::memory_order_acquire)) return true;
+    if (!wait) return false;
+
+    io->flush();
+    std::unique_lock<std::mutex> lk(io_mutex);
+    io_cv.wait(lk, [&f] { return !f.loading.load(); });
+    return true;
+}
+
+
+void BufferPool::drainReads() {
+    io->flush();
+    std::unique_lock<std::mutex> lk(io_mutex);
+    io_cv.wait(lk, [this] { return reads_in_flight.load() == 0; });
+}
+
+
+void BufferPool::writebackLoop() {
+    std::unique_lock<std::mutex> lk(writeback_mutex);
+    while (!stopping) {
+        writeback_cv.wait_for(lk, std::chrono::milliseconds(WRITEBACK_INTERVAL_MS));
+        if (!stopping) writeBack();
+    }
+}
+
+
+// Cleans dirty frames the CLOCK hand is about to reach, so evictions mostly find clean victims and
+// a miss rarely waits for a write. The writes of a pass are submitted together; their frames stay
+// share-latched until all of them finish, which keeps writers off a page while it is written.
+// Frames that are pinned or were used since the hand last passed are left alone.
+void BufferPool::writeBack() {
+    std::vector<int> batch;
+    {
+        std::lock_guard<std::mutex> lk(mutex);
+        int window = std::max(WRITEBACK_BATCH, num_frames / 4);
+        for (int k = 0, i = clock_hand; k < window && k < num_frames && (int)batch.size() < WRITEBACK_BATCH; k++, i = (i + 1) % num_frames) {
+            Frame& f = frames[i];
+            if (f.page_id == INVALID_PAGE_ID || !f.dirty.load() || f.pin_count.load() > 0 || f.usage > 1) continue;
+
+            f.pin_count.fetch_add(1);
+            batch.push_back(i);
+        }
+    }
+
+    std::vector<int> written;
+    for (size_t k = 0; k < batch.size(); k++) {
+        int id = batch[k];
+        Frame& f = frames[id];
+
+        if (!f.latch.tryLockShared()) {
+            f.pin_count.fetch_sub(1);
+            continue;
+        }
+        if (!f.dirty.load()) {
+            f.latch.unlock();
+            f.pin_count.fetch_sub(1);
+            continue;
+        }
+
+        const PoolFile& file = files[f.file];
+        f.dirty.store(false);
+        if (file.log) file.log->flush(framePage(id)->getHeader()->lsn);
+
+        {
+            std::lock_guard<std::mutex> lk(io_mutex);
+            writes_in_flight++;
+        }
+        IoRequest r = { file.fd, framePage(id)->data, file.page_size, (off_t)f.page_id * file.page_size, true, writeDone, this, id };
+        io->submit(r);
+        written.push_back(id);
+    }
+
+    io->flush();
+    {
+        std::unique_lock<std::mutex> lk(io_mutex);
+        io_cv.wait(lk, [this] { return writes_in_flight == 0; });
+    }
+
+    for (size_t k = 0; k < written.size(); k++) {
+        frames[written[k]].latch.unlock();
+        frames[written[k]].pin_count.fetch_sub(1);
+    }
+
+    if (!written.empty()) {
+        std::lock_guard<std::mutex> lk(mutex);
+        st.writebacks += written.size();
+    }
+}
+
+
+void BufferPool::writeDone(void* ctx, long frame_id, ssize_t res) {
+    BufferPool* pool = static_cast<BufferPool*>(ctx);
+    if (res != pool->files[pool->frames[frame_id].file].page_size) {
+        errno = res < 0 ? -res : EIO;
+        perror("Page Write Failed");
+        exit(1);
+    }
+
+    {
+        std::lock_guard<std::mutex> lk(pool->io_mutex);
+        pool->writes_in_flight--;
+    }
+    pool->io_cv.notify_all();
+}
+
+
+// Looks up a cached page without the pool mutex, a pin or a latch, and without counting a hit, so
+// threads reading the same hot pages write nothing they share. The page table may be changing
+// underneath: a slot read halfway through an update, or an entry missed because it was just moved,
+// only sends the caller back to fetchPage(), and the frame's own page id, read after its version,
+// decides whether the right page was found. A frame CLOCK has aged to zero gets its usage back, so
+// pages that are only ever read this way are not evicted for it. Returns false with r.frame at -1
+// when the page was not found, and false when its frame is being written.
+bool BufferPool::readOptimistic(int file, PageId page_id, OptimisticRead& r) {
+    r.frame = -1;
+    size_t i = homeSlot(file, page_id);
+    for (size_t probes = 0; probes <= table_mask; probes++, i = (i + 1) & table_mask) {
+        const PageSlot& s = page_table[i];
+        int id = __atomic_load_n(&s.frame, __ATOMIC_RELAXED);
+        if (id < 0 || id >= num_frames) return false;
+        if (s.page_id != page_id || s.file != file) continue;
+
+        Frame& f = frames[id];
+        r.version = f.version.load(std::memory_order_acquire);
+        if (f.page_id != page_id || f.file != file) return false;
+
+        r.frame = id;
+        if (r.version & 1) return false;
+
+        r.page = framePage(id);
+
+        if (f.usage.load(std::memory_order_relaxed) == 0) f.usage.store(1, std::memory_order_relaxed);
+        return true;
+    }
+    return false;
+}
+
+
+PageGuard BufferPool::newPage(int file, PageId page_id) {
+    if (page_id < 0) return PageGuard();
+
+    std::unique_lock<std::mutex> lk(mutex);
+
+    int id = lookup(file, page_id);
+    int victim = id < 0 ? findVictim(lk, file, page_id) : -1;
+    bool cached = victim < 0;
+    if (cached) {
+        if (id < 0) id = lookup(file, page_id);
+        frames[id].pin_count.fetch_add(1);
+    } else {
+        id = victim;
+        frames[id].latch.tryLockExclusive();
+        beginWrite(frames[id]);
+        frames[id].file = file;
+        frames[id].page_id = page_id;
+        frames[id].pin_count.store(1);
+        mapPage(file, page_id, id);
+    }
+
+    Frame& f = frames[id];
+    f.usage = 1;
+    lk.unlock();
+
+    if (cached) {
+        waitLoaded(f, true);
+        latchFrame(f, LATCH_EXCLUSIVE, true);
+    }
+    std::memset(framePage(id)->data, 0, page_size);
+    f.dirty.store(true);
+
+    return PageGuard(this, id, framePage(id), LATCH_EXCLUSIVE);
+}
+
+
+void BufferPool::flushFrames(int file) {
+    std::lock_guard<std::mutex> wb(writeback_mutex);
+    for (int i = 0; i < num_frames; i++) {
+        Frame& f = frames[i];
+        {
+            std::lock_guard<std::mutex> lk(mutex);
+            if (f.page_id == INVALID_PAGE_ID || !f.dirty.load()) continue;
+            if (file >= 0 && f.file != file) continue;
+            f.pin_count.fetch_add(1);
+        }
+
+        f.latch.lockShared();
+        bool written = f.dirty.load();
+        if (written) writeFrame(i);
+        f.latch.unlock();
+        f.pin_count.fetch_sub(1);
+
+        if (written) {
+            std::lock_guard<std::mutex> lk(mutex);
+            st.writebacks++;
+        }
+    }
+}
+
+
+BufferPoolStats BufferPool::stats() {
+    std::lock_guard<std::mutex> lk(mutex);
+    return st;
+}
@@ -0,0 +1,162 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include "common.h"
+#include "Latch.h"
+#include "AsyncIO.h"
+#include <vector>
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+struct BufferPoolStats {
+    long long hits;
+    long long misses;
+    long long evictions;
+    long long writebacks;
+};
+
+struct Frame {
+    int file;
+    PageId page_id;
+    std::atomic<int> pin_count;
+    std::atomic<int> usage;
+    std::atomic<bool> dirty;
+    // Set while a background read fills the frame; fetches wait for it before latching.
+    std::atomic<bool> loading;
+    RWLatch latch;
+    // Odd from the moment the frame is exclusively latched, or picked to hold another page, until
+    // the latch is released; every such hold therefore moves it on by two.
+    std::atomic<uint64_t> version;
+};
+
+// A cached page read without pin or latch. The frame can be rewritten or handed to another page
+// at any moment, so nothing read through it counts until validate() sees the version unchanged.
+struct OptimisticRead {
+    Page* page;
+    int frame;
+    uint64_t version;
+};
+
+class BufferPool;
+class LogManager;
+
+class PageGuard {
+    BufferPool* pool;
+    int frame_id;
+    Page* page;
+    LatchMode mode;
+public:
+    PageGuard() : pool(nullptr), frame_id(-1), page(nullptr), mode(LATCH_NONE) {}
+    PageGuard(BufferPool* pool, int frame_id, Page* page, LatchMode mode) : pool(pool), frame_id(frame_id), page(page), mode(mode) {}
+    PageGuard(PageGuard&& other);
+    PageGuard& operator=(PageGuard&& other);
+    PageGuard(const PageGuard&) = delete;
+    PageGuard& operator=(const PageGuard&) = delete;
+    ~PageGuard() { release(); }
+
+    Page* get() const { return page; }
+    Page* operator->() const { return page; }
+    explicit operator bool() const { return page != nullptr; }
+
+    void markDirty();
+    void release();
+};
+
+// Page table entry. The table is open-addressed with linear probing, so a lookup usually touches
+// a single slot, and that slot can be prefetched before the page is fetched.
+struct PageSlot {
+    int file;
+    PageId page_id;
+    int frame;
+};
+
+// An index file cached by the pool. Every index attached to one pool competes for the same frames
+// and is read and written back through the same eviction sweep.
+struct PoolFile {
+    int fd;
+    int page_size;
+    LogManager* log;
+};
+
+class BufferPool {
+    int num_frames;
+    int page_size;
+
+    char* pool_mem;
+    std::vector<Frame> frames;
+    std::vector<PageSlot> page_table;
+    size_t table_mask;
+    PoolFile files[MAX_POOL_FILES];
+    int clock_hand;
+    BufferPoolStats st;
+    std::mutex mutex;
+
+    AsyncIO* io;
+    int max_reads;
+    std::atomic<int> reads_in_flight;
+    int writes_in_flight;
+    std::mutex io_mutex;
+    std::condition_variable io_cv;
+
+    std::thread writeback_thread;
+    std::mutex writeback_mutex;
+    std::condition_variable writeback_cv;
+    bool stopping;
+
+    friend class PageGuard;
+
+    Page* framePage(int frame_id) { return reinterpret_cast<Page*>(pool_mem + (long)frame_id * page_size); }
+    size_t homeSlot(int file, PageId page_id) const {
+        uint64_t h = ((uint64_t)page_id * MAX_POOL_FILES + file) * 0x9E3779B97F4A7C15ULL;
+        return (size_t)(h ^ (h >> 32)) & table_mask;
+    }
+    int lookup(int file, PageId page_id) const;
+    void mapPage(int file, PageId page_id, int frame_id);
+    void unmapPage(int file, PageId page_id);
+    int findVictim(std::unique_lock<std::mutex>& lk, int file, PageId page_id);
+    bool writeVictim(std::unique_lock<std::mutex>& lk, int frame_id);
+    void writeFrame(int frame_id);
+    bool waitLoaded(Frame& f, bool wait);
+    static void readDone(void* ctx, long frame_id, ssize_t res);
+    static void writeDone(void* ctx, long frame_id, ssize_t res);
+    void writebackLoop();
+    void writeBack();
+    void drainReads();
+    bool latchFrame(Frame& f, LatchMode mode, bool wait);
+    void beginWrite(Frame& f) {
+        f.version.store(f.version.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+    void endWrite(Frame& f) { f.version.store(f.version.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+    void unpin(int frame_id, LatchMode mode);
+    void flushFrames(int file);
+public:
+    BufferPool(int num_frames, int page_size);
+    ~BufferPool();
+
+    int attach(int fd, int page_size, LogManager* log);
+    void detach(int file);
+
+    PageGuard fetchPage(int file, PageId page_id, LatchMode mode, bool wait = true);
+    PageGuard newPage(int file, PageId page_id);
+    bool prefetch(int file, PageId page_id);
+    void startReads() { io->flush(); }
+    void prefetchSlot(int file, PageId page_id) const { __builtin_prefetch(&page_table[homeSlot(file, page_id)]); }
+    bool readOptimistic(int file, PageId page_id, OptimisticRead& r);
+    bool validate(const OptimisticRead& r) const {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return frames[r.frame].version.load(std::memory_order_relaxed) == r.version;
+    }
+
+    void flushFile(int file) { flushFrames(file); }
+    void flushAll() { flushFrames(-1); }
+    int size() const { return num_frames; }
+    int pageSize() const { return page_size; }
+    const char* ioBackend() const { return io->backend(); }
+    BufferPoolStats stats();
+};
+
+#endif
@@ -0,0 +1,125 @@
+#include "Compression.h"
+#include <cstring>
+#include <cstdint>
+
+// LZ4-style sequences: a token with the literal count in its high nibble and the match length
+// minus MIN_MATCH in its low nibble (15 means more length bytes follow), the literals, then a
+// 2-byte match offset. The last sequence has literals only; the decoder stops at n bytes.
+
+const int MIN_MATCH = 4;
+const int HASH_BITS = 8;
+const int MAX_OFFSET = 65535;
+
+
+static inline unsigned hash4(const char* p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+
+static bool putLength(char* dst, int& op, int cap, int len) {
+    while (len >= 255) {
+        if (op >= cap) return false;
+        dst[op++] = (char)255;
+        len -= 255;
+    }
+    if (op >= cap) return false;
+    dst[op++] = (char)len;
+    return true;
+}
+
+
+static bool putSequence(char* dst, int& op, int cap, const char* lit, int lit_len, int offset, int match_len) {
+    if (op >= cap) return false;
+
+    int m = match_len > 0 ? match_len - MIN_MATCH : 0;
+    dst[op++] = (char)(((lit_len < 15 ? lit_len : 15) << 4) | (m < 15 ? m : 15));
+
+    if (lit_len >= 15 && !putLength(dst, op, cap, lit_len - 15)) return false;
+    if (op + lit_len > cap) return false;
+    std::memcpy(dst + op, lit, lit_len);
+    op += lit_len;
+
+    if (match_len == 0) return true;
+
+    if (op + 2 > cap) return false;
+    dst[op++] = (char)(offset & 0xFF);
+    dst[op++] = (char)(offset >> 8);
+
+    return m < 15 || putLength(dst, op, cap, m - 15);
+}
+
+
+int lzCompress(const char* src, int n, char* dst, int cap) {
+    int table[1 << HASH_BITS];
+    for (int i = 0; i < (1 << HASH_BITS); i++) table[i] = -1;
+
+    int ip = 0, anchor = 0, op = 0;
+
+    while (ip + MIN_MATCH <= n) {
+        unsigned h = hash4(src + ip);
+        int ref = table[h];
+        table[h] = ip;
+
+        if (ref < 0 || ip - ref > MAX_OFFSET || std::memcmp(src + ref, src + ip, MIN_MATCH) != 0) {
+            ip++;
+            continue;
+        }
+
+        int len = MIN_MATCH;
+        while (ip + len < n && src[ref + len] == src[ip + len]) len++;
+
+        if (!putSequence(dst, op, cap, src + anchor, ip - anchor, ip - ref, len)) return -1;
+
+        ip += len;
+        anchor = ip;
+    }
+
+    if (anchor < n && !putSequence(dst, op, cap, src + anchor, n - anchor, 0, 0)) return -1;
+
+    return op;
+}
+
+
+static bool getLength(const char* src, int& ip, int len, int& out) {
+    unsigned char b;
+    do {
+        if (ip >= len) return false;
+        b = (unsigned char)src[ip++];
+        out += b;
+    } while (b == 255);
+    return true;
+}
+
+
+bool lzDecompress(const char* src, int len, char* dst, int n) {
+    int ip = 0, op = 0;
+
+    while (op < n) {
+        if (ip >= len) return false;
+        unsigned char token = (unsigned char)src[ip++];
+
+        int lit = token >> 4;
+        if (lit == 15 && !getLength(src, ip, len, lit)) return false;
+        if (ip + lit > len || op + lit > n) return false;
+        std::memcpy(dst + op, src + ip, lit);
+        ip += lit;
+        op += lit;
+
+        if (op == n) break;
+
+        if (ip + 2 > len) return false;
+        int offset = (unsigned char)src[ip] | ((unsigned char)src[ip + 1] << 8);
+        ip += 2;
+
+        int m = token & 15;
+        if (m == 15 && !getLength(src, ip, len, m)) return false;
+        m += MIN_MATCH;
+
+        if (offset == 0 || offset > op || op + m > n) return false;
+        for (int i = 0; i < m; i++, op++) dst[op] = dst[op - offset];
+    }
+
+    return op == n && ip == len;
+}
@@ -0,0 +1,7 @@
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+int lzCompress(const char* src, int n, char* dst, int cap);
+bool lzDecompress(const char* src, int len, char* dst, int n);
+
+#endif
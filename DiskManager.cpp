@@ -4,37 +4,57 @@
 #include <unistd.h>
 
 #include <sys/stat.h>
-#include <sys/mman.h>
 #include <cstdlib>
+#include <cerrno>
+#include <algorithm>
 
 const char* DB_FILE = "index.bin";
+const char* WAL_FILE = "index.wal";
+const char* VAR_DB_FILE = "varindex.bin";
+const char* VAR_WAL_FILE = "varindex.wal";
 
 
 
-DiskManager::DiskManager() {
+DiskManager::DiskManager(int pool_frames, const char* path, const char* wal_path, int page_size, RedoFn redo, BufferPool* shared_pool)
+    : page_size(page_size), redo(redo), pool(shared_pool), owns_pool(shared_pool == nullptr) {
 
-    fd = open(DB_FILE, O_RDWR | O_CREAT, 0644);
+    fd = open(path, O_RDWR | O_CREAT, 0644);
     if (fd < 0) { perror("DB Open Failed"); exit(1); }
 
     struct stat st;
 
     fstat(fd, &st);
+    bool fresh = st.st_size == 0;
 
-    
-    if (st.st_size < (off_t)MAX_DB_SIZE) {
+    if (!fresh) {
+        char head[sizeof(PageHeader) + sizeof(MetaPageData)];
+        std::memset(head, 0, sizeof(head));
+        if (pread(fd, head, sizeof(head), 0) < 0) { perror("DB Read Failed"); exit(1); }
 
-        if (ftruncate(fd, MAX_DB_SIZE) != 0) { perror("Resize Failed"); exit(1); }
+        const MetaPageData* mp = reinterpret_cast<const MetaPageData*>(head + sizeof(PageHeader));
+        if (reinterpret_cast<const PageHeader*>(head)->page_type == PAGE_META && mp->page_size != 0 && mp->page_size != page_size) {
+            std::cerr << path << " has " << mp->page_size << "-byte pages, opened with " << page_size << std::endl;
+            exit(1);
+        }
     }
 
-    map_addr = (char*)mmap(NULL, MAX_DB_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-    if (map_addr == MAP_FAILED) { perror("mmap Failed"); exit(1); }
+    if (pool_frames < MIN_POOL_FRAMES) pool_frames = MIN_POOL_FRAMES;
+    log = new LogManager(wal_path, page_size);
+    if (owns_pool) pool = new BufferPool(pool_frames, page_size);
+    file = pool->attach(fd, page_size, log);
+
+    if (fresh) log->reset();
+    else recover();
 
+    fstat(fd, &st);
+    file_pages = st.st_size / page_size;
 
-    Page* meta = getPage(0);
+
+    PageGuard meta = getPage(0, LATCH_SHARED);
 
     if (meta->getHeader()->page_type == PAGE_INVALID) {
 
-        next_page_id = 1; 
+        next_page_id = 1;
     } else {
 
         MetaPageData* mp = reinterpret_cast<MetaPageData*>(meta->data + sizeof(PageHeader));
@@ -46,47 +66,109 @@ DiskManager::DiskManager() {
 
 
 DiskManager::~DiskManager() {
-    if (map_addr != MAP_FAILED) {
-        Page* meta = getPage(0);
+    {
+        std::lock_guard<std::mutex> lk(alloc_mutex);
+        reclaimPages(true);
+    }
+    sync();
+    log->reset();
+    if (owns_pool) delete pool;
+    else pool->detach(file);
+    delete log;
+    if (fd > 0) close(fd);
+}
+
+
+void DiskManager::recover() {
+    long long lsn = log->checkpointLsn();
+    std::vector<char> rec;
+    std::vector<PageId> applied;
+
+    while (log->readRecord(lsn, rec)) {
+        applied.clear();
 
-        if (meta->getHeader()->page_type == PAGE_META) {
-            MetaPageData* mp = reinterpret_cast<MetaPageData*>(meta->data + sizeof(PageHeader));
+        for (size_t off = 0; off < rec.size(); ) {
+            LogEntryHeader e;
+            std::memcpy(&e, &rec[off], sizeof(e));
 
-            mp->total_pages_allocated = next_page_id;
+            PageGuard p = pool->fetchPage(file, e.page_id, LATCH_EXCLUSIVE);
+            bool seen = std::find(applied.begin(), applied.end(), e.page_id) != applied.end();
+
+            if (e.type == LOG_PAGE_IMAGE || seen || p->getHeader()->lsn < lsn) {
+                if (!redoPageEntry(p.get(), &e, &rec[off + sizeof(e)]) && redo) redo(p.get(), &e, &rec[off + sizeof(e)]);
+                p->getHeader()->lsn = lsn;
+                p.markDirty();
+                if (!seen) applied.push_back(e.page_id);
+            }
+
+            off += sizeof(e) + e.len;
         }
-        msync(map_addr, MAX_DB_SIZE, MS_SYNC);
-        munmap(map_addr, MAX_DB_SIZE);
     }
-    if (fd > 0) close(fd);
+
+    log->startAt(lsn);
+    pool->flushFile(file);
+    fdatasync(fd);
+    log->reset();
 }
 
-Page* DiskManager::getPage(int page_id) {
 
-    if (page_id < 0 || (long)page_id * PAGE_SIZE >= MAX_DB_SIZE) return nullptr;
+PageGuard DiskManager::getPage(PageId page_id, LatchMode mode, bool wait) {
+
+    if (page_id < 0) return PageGuard();
 
-    return reinterpret_cast<Page*>(map_addr + ((long)page_id * PAGE_SIZE));
+    return pool->fetchPage(file, page_id, mode, wait);
 }
 
 
-int DiskManager::allocatePage() {
+PageGuard DiskManager::newPage(PageId page_id) {
 
-    int id = next_page_id++;
+    if (page_id < 0) return PageGuard();
 
-    if ((long)id * PAGE_SIZE >= MAX_DB_SIZE) {
-        std::cerr << "Disk Full!" << std::endl;
+    return pool->newPage(file, page_id);
+}
 
-        exit(1);
 
+PageId DiskManager::allocatePage() {
+
+    std::lock_guard<std::mutex> lk(alloc_mutex);
+    reclaimPages(false);
+
+    PageGuard meta = getPage(0, LATCH_EXCLUSIVE);
+    MetaPageData* mp = reinterpret_cast<MetaPageData*>(meta->data + sizeof(PageHeader));
+
+    if (meta->getHeader()->page_type == PAGE_META && mp->free_list_head > 0) {
+
+        PageId id = mp->free_list_head;
+        PageGuard p = getPage(id, LATCH_SHARED);
+
+        mp->free_list_head = p->getHeader()->right_link;
+        mp->free_page_count--;
+        meta.markDirty();
+
+        MiniTxn mtx;
+        mtx.logBytes(meta.get(), sizeof(PageHeader), sizeof(MetaPageData));
+        log->commit(mtx);
+
+        return id;
+    }
+
+    if (next_page_id == std::numeric_limits<PageId>::max()) {
+        std::cerr << "Page id space exhausted" << std::endl;
+        exit(1);
     }
-    Page* p = getPage(id);
+    PageId id = next_page_id++;
+
+    if (id >= file_pages) growFile(id + 1);
 
-    std::memset(p->data, 0, PAGE_SIZE);
 
-    
-    Page* meta = getPage(0);
     if (meta->getHeader()->page_type == PAGE_META) {
 
         reinterpret_cast<MetaPageData*>(meta->data + sizeof(PageHeader))->total_pages_allocated = next_page_id;
+        meta.markDirty();
+
+        MiniTxn mtx;
+        mtx.logBytes(meta.get(), sizeof(PageHeader), sizeof(MetaPageData));
+        log->commit(mtx);
 
     }
 
@@ -94,6 +176,116 @@ int DiskManager::allocatePage() {
 }
 
 
-void DiskManager::sync() { 
-    msync(map_addr, MAX_DB_SIZE, MS_SYNC); 
-}
\ No newline at end of file
+// A freed page is not put on the free list straight away: descents read child ids and right links
+// without holding the page they came from, so a thread may still be on its way to it. It waits in
+// retired until every operation that was running when it was freed has finished.
+void DiskManager::deallocatePage(PageId page_id) {
+
+    if (page_id <= 0) return;
+
+    std::lock_guard<std::mutex> lk(alloc_mutex);
+
+    RetiredPage r = { page_id, EpochManager::instance().retire() };
+    retired.push_back(r);
+    reclaimPages(false);
+}
+
+
+// Moves retired pages no thread can reach any more onto the free list, or all of them when the
+// index is closing. Pages are retired in epoch order, so the reusable ones form a prefix.
+void DiskManager::reclaimPages(bool all) {
+
+    if (retired.empty()) return;
+
+    uint64_t horizon = all ? std::numeric_limits<uint64_t>::max() : EpochManager::instance().horizon();
+
+    size_t n = 0;
+    while (n < retired.size() && retired[n].epoch < horizon) releasePage(retired[n++].page_id);
+
+    retired.erase(retired.begin(), retired.begin() + n);
+}
+
+
+void DiskManager::releasePage(PageId page_id) {
+
+    PageGuard meta = getPage(0, LATCH_EXCLUSIVE);
+    MetaPageData* mp = reinterpret_cast<MetaPageData*>(meta->data + sizeof(PageHeader));
+
+    PageGuard p = newPage(page_id);
+    PageHeader* h = p->getHeader();
+
+    h->page_id = page_id;
+    h->page_type = PAGE_FREE;
+    h->right_link = mp->free_list_head > 0 ? mp->free_list_head : INVALID_PAGE_ID;
+    h->extra_ptr = INVALID_PAGE_ID;
+
+    mp->free_list_head = page_id;
+    mp->free_page_count++;
+    meta.markDirty();
+
+    MiniTxn mtx;
+    mtx.logImage(p.get());
+    mtx.logBytes(meta.get(), sizeof(PageHeader), sizeof(MetaPageData));
+    log->commit(mtx);
+}
+
+
+long long DiskManager::freePageCount() {
+
+    PageGuard meta = getPage(0, LATCH_SHARED);
+
+    if (meta->getHeader()->page_type != PAGE_META) return 0;
+
+    return reinterpret_cast<MetaPageData*>(meta->data + sizeof(PageHeader))->free_page_count;
+}
+
+
+void DiskManager::growFile(long long min_pages) {
+
+    long long extent = file_pages / 8;
+    if (extent < EXTENT_PAGES) extent = EXTENT_PAGES;
+    if (extent > MAX_EXTENT_PAGES) extent = MAX_EXTENT_PAGES;
+
+    long long target = file_pages + extent;
+    if (target < min_pages) target = min_pages;
+
+    off_t off = (off_t)file_pages * page_size;
+    off_t len = (off_t)(target - file_pages) * page_size;
+
+    int err = posix_fallocate(fd, off, len);
+    if (err == EOPNOTSUPP || err == EINVAL) {
+        err = ftruncate(fd, off + len) == 0 ? 0 : errno;
+    }
+    if (err != 0) {
+        errno = err;
+        perror("Disk Full!");
+
+        exit(1);
+    }
+
+    file_pages = target;
+}
+
+
+void DiskManager::waitDurable(long long lsn) {
+    log->flush(lsn);
+
+    if (log->sinceCheckpoint() < WAL_CHECKPOINT_BYTES) return;
+
+    std::unique_lock<std::mutex> lk(checkpoint_mutex, std::try_to_lock);
+    if (lk.owns_lock()) runCheckpoint();
+}
+
+
+void DiskManager::runCheckpoint() {
+    long long redo_lsn = log->beginCheckpoint();
+    pool->flushFile(file);
+    fdatasync(fd);
+    log->endCheckpoint(redo_lsn);
+}
+
+
+void DiskManager::sync() {
+    std::lock_guard<std::mutex> lk(checkpoint_mutex);
+    runCheckpoint();
+}
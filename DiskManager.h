@@ -1,20 +1,69 @@
 #ifndef DISK_MANAGER_H
 #define DISK_MANAGER_H
 #include "common.h"
+#include "BufferPool.h"
+#include "LogManager.h"
+#include "Epoch.h"
+#include <mutex>
+#include <atomic>
+#include <vector>
+// Redo for node-level log entries, supplied by the index that owns the file.
+typedef void (*RedoFn)(Page* p, const LogEntryHeader* e, const char* data);
+
+// A page freed by the tree that threads may still be reading, with the epoch it was retired in.
+struct RetiredPage {
+    PageId page_id;
+    uint64_t epoch;
+};
+
 class DiskManager {
 
     int fd;
+    int page_size;
+    RedoFn redo;
 
-    char* map_addr;
-    int next_page_id;
+    BufferPool* pool;
+    bool owns_pool;
+    int file;
+    LogManager* log;
+    PageId next_page_id;
+    std::vector<RetiredPage> retired;
+    std::atomic<long long> file_pages;
+    std::mutex alloc_mutex;
+    std::mutex checkpoint_mutex;
+
+    void growFile(long long min_pages);
+    void releasePage(PageId page_id);
+    void reclaimPages(bool all);
+    void recover();
+    void runCheckpoint();
 public:
-    DiskManager();
+    DiskManager(int pool_frames = DEFAULT_POOL_FRAMES, const char* path = DB_FILE, const char* wal_path = WAL_FILE, int page_size = PAGE_SIZE, RedoFn redo = nullptr,
+                BufferPool* shared_pool = nullptr);
     ~DiskManager();
-    Page* getPage(int page_id);
+    PageGuard getPage(PageId page_id, LatchMode mode, bool wait = true);
+    PageGuard newPage(PageId page_id);
+    bool prefetch(PageId page_id) { return page_id > 0 && pool->prefetch(file, page_id); }
+    void prefetchSlot(PageId page_id) const { pool->prefetchSlot(file, page_id); }
+    void startReads() { pool->startReads(); }
+    bool readOptimistic(PageId page_id, OptimisticRead& r) {
+        r.frame = -1;
+        return page_id > 0 && pool->readOptimistic(file, page_id, r);
+    }
+    bool validate(const OptimisticRead& r) const { return pool->validate(r); }
+
+    PageId allocatePage();
+    void deallocatePage(PageId page_id);
+    long long freePageCount();
 
-    int allocatePage();
+    void commit(MiniTxn& mtx) { log->commit(mtx); }
+    void waitDurable(long long lsn);
 
     void sync();
+    BufferPoolStats poolStats() { return pool->stats(); }
+    int poolFrames() const { return pool->size(); }
+    long long filePages() const { return file_pages; }
+    int pageSize() const { return page_size; }
 };
 
 #endif
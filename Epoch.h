@@ -0,0 +1,117 @@
+#ifndef EPOCH_H
+#define EPOCH_H
+
+#include "common.h"
+#include <atomic>
+#include <cstdint>
+
+// Epoch-based reclamation for pages that threads may still reach through ids they read before the
+// page was unlinked. A tree operation announces the global epoch in its thread's slot on entry and
+// clears it on exit; retiring a page advances the epoch, and the page may be reused once every
+// announced epoch is newer than the one it was retired in. Each thread writes only its own slot,
+// so the read path pays one store and one fence per operation. One manager serves every index in
+// the process; threads beyond MAX_EPOCH_THREADS share a counter that holds back all reuse while
+// any of them is inside an operation.
+class EpochManager {
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> epoch;
+        std::atomic<bool> used;
+    };
+
+    struct ThreadState {
+        Slot* slot;
+        int depth;
+        bool claimed;
+
+        ThreadState() : slot(nullptr), depth(0), claimed(false) {}
+        ~ThreadState() {
+            if (slot) slot->used.store(false, std::memory_order_release);
+        }
+    };
+
+    std::atomic<uint64_t> global;
+    std::atomic<int> slots_used;
+    std::atomic<int> unregistered;
+    Slot slots[MAX_EPOCH_THREADS];
+
+    EpochManager() : global(1), slots_used(0), unregistered(0) {
+        for (int i = 0; i < MAX_EPOCH_THREADS; i++) {
+            slots[i].epoch.store(0);
+            slots[i].used.store(false);
+        }
+    }
+
+    static ThreadState& state() {
+        static thread_local ThreadState t;
+        return t;
+    }
+
+    void claim(ThreadState& t) {
+        t.claimed = true;
+        for (int i = 0; i < MAX_EPOCH_THREADS; i++) {
+            bool free = false;
+            if (!slots[i].used.compare_exchange_strong(free, true)) continue;
+
+            int n = slots_used.load();
+            while (n <= i && !slots_used.compare_exchange_weak(n, i + 1)) {}
+            t.slot = &slots[i];
+            return;
+        }
+    }
+public:
+    EpochManager(const EpochManager&) = delete;
+    EpochManager& operator=(const EpochManager&) = delete;
+
+    static EpochManager& instance() {
+        static EpochManager m;
+        return m;
+    }
+
+    // Nested calls from the same thread keep the epoch announced by the outermost one.
+    void enter() {
+        ThreadState& t = state();
+        if (t.depth++ > 0) return;
+        if (!t.claimed) claim(t);
+
+        if (!t.slot) {
+            unregistered.fetch_add(1);
+            return;
+        }
+        t.slot->epoch.store(global.load(std::memory_order_acquire), std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
+    void exit() {
+        ThreadState& t = state();
+        if (--t.depth > 0) return;
+
+        if (t.slot) t.slot->epoch.store(0, std::memory_order_release);
+        else unregistered.fetch_sub(1);
+    }
+
+    // Stamps a page that is no longer reachable from the tree. Call it after the page was unlinked.
+    uint64_t retire() { return global.fetch_add(1); }
+
+    // Pages retired with a stamp below the horizon can no longer be reached by any thread.
+    uint64_t horizon() const {
+        if (unregistered.load() > 0) return 0;
+
+        uint64_t h = global.load();
+        int n = slots_used.load();
+        for (int i = 0; i < n; i++) {
+            uint64_t e = slots[i].epoch.load();
+            if (e != 0 && e < h) h = e;
+        }
+        return h;
+    }
+};
+
+class EpochGuard {
+public:
+    EpochGuard() { EpochManager::instance().enter(); }
+    ~EpochGuard() { EpochManager::instance().exit(); }
+    EpochGuard(const EpochGuard&) = delete;
+    EpochGuard& operator=(const EpochGuard&) = delete;
+};
+
+#endif
@@ -0,0 +1,160 @@
+#include "KeySearch.h"
+#include <limits>
+
+#if !defined(BPT_NO_SIMD) && (defined(__x86_64__) || defined(__i386__))
+#define KEY_SEARCH_X86
+#include <immintrin.h>
+#endif
+
+const int SEARCH_WINDOW = 32;
+
+typedef int (*CountLess32Fn)(const int* keys, int n, int key);
+typedef int (*CountLess64Fn)(const long long* keys, int n, long long key);
+
+
+template <typename K>
+static int countLessScalar(const K* keys, int n, K key) {
+    int c = 0;
+    for (int i = 0; i < n; i++) c += keys[i] < key;
+    return c;
+}
+
+
+#ifdef KEY_SEARCH_X86
+
+static int countLessSse2(const int* keys, int n, int key) {
+    __m128i k = _mm_set1_epi32(key);
+    int c = 0, i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i));
+        c += __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(k, v))));
+    }
+    for (; i < n; i++) c += keys[i] < key;
+    return c;
+}
+
+
+__attribute__((target("avx2,popcnt")))
+static int countLessAvx2(const int* keys, int n, int key) {
+    __m256i k = _mm256_set1_epi32(key);
+    int c = 0, i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i));
+        c += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(k, v))));
+    }
+    if (i + 4 <= n) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i));
+        c += __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(_mm256_castsi256_si128(k), v))));
+        i += 4;
+    }
+    for (; i < n; i++) c += keys[i] < key;
+    return c;
+}
+
+
+__attribute__((target("sse4.2,popcnt")))
+static int countLessSse42(const long long* keys, int n, long long key) {
+    __m128i k = _mm_set1_epi64x(key);
+    int c = 0, i = 0;
+
+    for (; i + 2 <= n; i += 2) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i));
+        c += __builtin_popcount(_mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(k, v))));
+    }
+    for (; i < n; i++) c += keys[i] < key;
+    return c;
+}
+
+
+__attribute__((target("avx2,popcnt")))
+static int countLessAvx2(const long long* keys, int n, long long key) {
+    __m256i k = _mm256_set1_epi64x(key);
+    int c = 0, i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i));
+        c += __builtin_popcount(_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(k, v))));
+    }
+    for (; i < n; i++) c += keys[i] < key;
+    return c;
+}
+
+#endif
+
+
+static const char* kernel_name32 = "scalar";
+static const char* kernel_name64 = "scalar";
+
+static CountLess32Fn pickKernel32() {
+#ifdef KEY_SEARCH_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        kernel_name32 = "avx2";
+        return countLessAvx2;
+    }
+    kernel_name32 = "sse2";
+    return countLessSse2;
+#else
+    return countLessScalar<int>;
+#endif
+}
+
+static CountLess64Fn pickKernel64() {
+#ifdef KEY_SEARCH_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        kernel_name64 = "avx2";
+        return countLessAvx2;
+    }
+    if (__builtin_cpu_supports("sse4.2")) {
+        kernel_name64 = "sse4.2";
+        return countLessSse42;
+    }
+#endif
+    return countLessScalar<long long>;
+}
+
+static const CountLess32Fn count_less32 = pickKernel32();
+static const CountLess64Fn count_less64 = pickKernel64();
+
+
+template <typename K, typename CountLess>
+static int lowerBound(const K* keys, int n, K key, CountLess count_less) {
+    int lo = 0;
+
+    while (n > SEARCH_WINDOW) {
+        int half = n / 2;
+        if (keys[lo + half] < key) {
+            lo += half + 1;
+            n -= half + 1;
+        } else {
+            n = half;
+        }
+    }
+
+    return lo + count_less(keys + lo, n, key);
+}
+
+
+int keyLowerBound(const int* keys, int n, int key) { return lowerBound(keys, n, key, count_less32); }
+
+int keyLowerBound(const long long* keys, int n, long long key) { return lowerBound(keys, n, key, count_less64); }
+
+
+int keyUpperBound(const int* keys, int n, int key) {
+    if (key == std::numeric_limits<int>::max()) return n;
+
+    return keyLowerBound(keys, n, key + 1);
+}
+
+
+int keyUpperBound(const long long* keys, int n, long long key) {
+    if (key == std::numeric_limits<long long>::max()) return n;
+
+    return keyLowerBound(keys, n, key + 1);
+}
+
+
+const char* keySearchKernel() { return sizeof(KeyType) == sizeof(long long) ? kernel_name64 : kernel_name32; }
@@ -0,0 +1,35 @@
+#ifndef KEY_SEARCH_H
+#define KEY_SEARCH_H
+
+#include "common.h"
+#include <algorithm>
+#include <functional>
+
+int keyLowerBound(const int* keys, int n, int key);
+int keyUpperBound(const int* keys, int n, int key);
+int keyLowerBound(const long long* keys, int n, long long key);
+int keyUpperBound(const long long* keys, int n, long long key);
+
+const char* keySearchKernel();
+
+// Search over a sorted key array. Integer keys in ascending order use the SIMD kernels; any other
+// key type or comparator falls back to a plain binary search.
+template <typename K, typename Compare>
+struct KeySearch {
+    static int lowerBound(const K* keys, int n, const K& key) { return std::lower_bound(keys, keys + n, key, Compare()) - keys; }
+    static int upperBound(const K* keys, int n, const K& key) { return std::upper_bound(keys, keys + n, key, Compare()) - keys; }
+};
+
+template <>
+struct KeySearch<int, std::less<int> > {
+    static int lowerBound(const int* keys, int n, int key) { return keyLowerBound(keys, n, key); }
+    static int upperBound(const int* keys, int n, int key) { return keyUpperBound(keys, n, key); }
+};
+
+template <>
+struct KeySearch<long long, std::less<long long> > {
+    static int lowerBound(const long long* keys, int n, long long key) { return keyLowerBound(keys, n, key); }
+    static int upperBound(const long long* keys, int n, long long key) { return keyUpperBound(keys, n, key); }
+};
+
+#endif
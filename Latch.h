@@ -0,0 +1,42 @@
+#ifndef LATCH_H
+#define LATCH_H
+
+#include <pthread.h>
+
+enum LatchMode { LATCH_NONE = 0, LATCH_SHARED = 1, LATCH_EXCLUSIVE = 2 };
+
+class RWLatch {
+    pthread_rwlock_t rwlock;
+public:
+    RWLatch() {
+        pthread_rwlockattr_t attr;
+        pthread_rwlockattr_init(&attr);
+        pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+        pthread_rwlock_init(&rwlock, &attr);
+        pthread_rwlockattr_destroy(&attr);
+    }
+    ~RWLatch() { pthread_rwlock_destroy(&rwlock); }
+    RWLatch(const RWLatch&) = delete;
+    RWLatch& operator=(const RWLatch&) = delete;
+
+    void lockShared() { pthread_rwlock_rdlock(&rwlock); }
+    void lockExclusive() { pthread_rwlock_wrlock(&rwlock); }
+    bool tryLockShared() { return pthread_rwlock_tryrdlock(&rwlock) == 0; }
+    bool tryLockExclusive() { return pthread_rwlock_trywrlock(&rwlock) == 0; }
+    void unlock() { pthread_rwlock_unlock(&rwlock); }
+
+    void lock(LatchMode mode) {
+        if (mode == LATCH_SHARED) lockShared();
+        else if (mode == LATCH_EXCLUSIVE) lockExclusive();
+    }
+    bool tryLock(LatchMode mode) {
+        if (mode == LATCH_SHARED) return tryLockShared();
+        if (mode == LATCH_EXCLUSIVE) return tryLockExclusive();
+        return true;
+    }
+    void unlock(LatchMode mode) {
+        if (mode != LATCH_NONE) unlock();
+    }
+};
+
+#endif
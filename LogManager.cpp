@@ -0,0 +1,288 @@
+#include "LogManager.h"
+#include <iostream>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <cstdlib>
+#include <cstdio>
+
+const int WAL_MAGIC = 0x4C415742;
+const int MAX_LOG_RECORD = 64 * 1024 * 1024;
+
+
+static unsigned int crc_table[256];
+
+static bool initCrcTable() {
+    for (unsigned int i = 0; i < 256; i++) {
+        unsigned int c = i;
+        for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        crc_table[i] = c;
+    }
+    return true;
+}
+
+static bool crc_ready = initCrcTable();
+
+static unsigned int crc32(const char* data, size_t len) {
+    unsigned int c = 0xFFFFFFFFu;
+    for (size_t i = 0; i < len; i++) c = crc_table[(c ^ (unsigned char)data[i]) & 0xFF] ^ (c >> 8);
+    return c ^ 0xFFFFFFFFu;
+}
+
+
+void MiniTxn::add(Page* p, int type, const void* data, int len) {
+    bool found = false;
+    for (size_t i = 0; i < pages.size(); i++) {
+        if (pages[i].page == p) { found = true; break; }
+    }
+    if (!found) {
+        LoggedPage lp = { p, false };
+        pages.push_back(lp);
+    }
+    if (type == LOG_PAGE_IMAGE) return;
+
+    LogEntryHeader e = { type, p->getHeader()->page_id, len };
+    size_t off = redo.size();
+    redo.resize(off + sizeof(e) + len);
+    std::memcpy(&redo[off], &e, sizeof(e));
+    std::memcpy(&redo[off + sizeof(e)], data, len);
+}
+
+
+void MiniTxn::logImage(Page* p) {
+    add(p, LOG_PAGE_IMAGE, nullptr, 0);
+    for (size_t i = 0; i < pages.size(); i++) {
+        if (pages[i].page == p) pages[i].image = true;
+    }
+}
+
+
+void MiniTxn::logBytes(Page* p, int offset, int len) {
+    std::vector<char> buf(sizeof(int) + len);
+    std::memcpy(buf.data(), &offset, sizeof(int));
+    std::memcpy(buf.data() + sizeof(int), p->data + offset, len);
+    add(p, LOG_PAGE_BYTES, buf.data(), buf.size());
+}
+
+
+bool redoPageEntry(Page* p, const LogEntryHeader* e, const char* data) {
+    switch (e->type) {
+    case LOG_PAGE_IMAGE:
+        std::memcpy(p->data, data, e->len);
+        return true;
+
+    case LOG_PAGE_BYTES: {
+        int offset;
+        std::memcpy(&offset, data, sizeof(int));
+        std::memcpy(p->data + offset, data + sizeof(int), e->len - sizeof(int));
+        return true;
+    }
+    }
+    return false;
+}
+
+
+LogManager::LogManager(const char* path, int page_size) : page_size(page_size), buffer_lsn(0), next_lsn(0), flushed_lsn(0), flushing(false) {
+    fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) { perror("WAL Open Failed"); exit(1); }
+
+    WalHeader wh;
+    std::memset(&wh, 0, sizeof(wh));
+    ssize_t n = pread(fd, &wh, sizeof(wh), 0);
+
+    if (n != (ssize_t)sizeof(wh) || wh.magic != WAL_MAGIC) {
+        base_lsn = 1;
+        checkpoint_lsn = 1;
+        if (ftruncate(fd, WAL_HEADER_SIZE) != 0) { perror("WAL Truncate Failed"); exit(1); }
+        writeHeader();
+    } else {
+        base_lsn = wh.base_lsn;
+        checkpoint_lsn = wh.checkpoint_lsn;
+    }
+
+    image_lsn = checkpoint_lsn;
+    buffer_lsn = next_lsn = flushed_lsn = checkpoint_lsn;
+}
+
+
+LogManager::~LogManager() {
+    if (fd >= 0) close(fd);
+}
+
+
+void LogManager::writeHeader() {
+    WalHeader wh;
+    std::memset(&wh, 0, sizeof(wh));
+    wh.magic = WAL_MAGIC;
+    wh.version = 1;
+    wh.base_lsn = base_lsn;
+    wh.checkpoint_lsn = checkpoint_lsn;
+
+    if (pwrite(fd, &wh, sizeof(wh), 0) != (ssize_t)sizeof(wh)) { perror("WAL Header Write Failed"); exit(1); }
+    fdatasync(fd);
+}
+
+
+void LogManager::commit(MiniTxn& mtx) {
+    if (mtx.pages.empty()) return;
+
+    std::lock_guard<std::mutex> lk(mutex);
+
+    int size = 0;
+    for (size_t i = 0; i < mtx.pages.size(); i++) {
+        LoggedPage& lp = mtx.pages[i];
+        if (lp.page->getHeader()->lsn < image_lsn) lp.image = true;
+        if (lp.image) size += sizeof(LogEntryHeader) + page_size;
+    }
+
+    std::vector<bool> keep_entry;
+    for (size_t off = 0; off < mtx.redo.size(); ) {
+        LogEntryHeader e;
+        std::memcpy(&e, &mtx.redo[off], sizeof(e));
+
+        bool imaged = false;
+        for (size_t i = 0; i < mtx.pages.size(); i++) {
+            if (mtx.pages[i].image && mtx.pages[i].page->getHeader()->page_id == e.page_id) { imaged = true; break; }
+        }
+        keep_entry.push_back(!imaged);
+        if (!imaged) size += sizeof(LogEntryHeader) + e.len;
+
+        off += sizeof(LogEntryHeader) + e.len;
+    }
+
+    long long lsn = next_lsn;
+    long long end = lsn + sizeof(LogRecordHeader) + size;
+    for (size_t i = 0; i < mtx.pages.size(); i++) mtx.pages[i].page->getHeader()->lsn = end;
+
+    size_t start = buffer.size();
+    buffer.resize(start + sizeof(LogRecordHeader) + size);
+    char* payload = &buffer[start + sizeof(LogRecordHeader)];
+    char* out = payload;
+
+    for (size_t i = 0; i < mtx.pages.size(); i++) {
+        if (!mtx.pages[i].image) continue;
+        LogEntryHeader e = { LOG_PAGE_IMAGE, mtx.pages[i].page->getHeader()->page_id, page_size };
+        std::memcpy(out, &e, sizeof(e));
+        std::memcpy(out + sizeof(e), mtx.pages[i].page->data, page_size);
+        out += sizeof(e) + page_size;
+    }
+
+    size_t idx = 0;
+    for (size_t off = 0; off < mtx.redo.size(); idx++) {
+        LogEntryHeader e;
+        std::memcpy(&e, &mtx.redo[off], sizeof(e));
+        size_t len = sizeof(LogEntryHeader) + e.len;
+        if (keep_entry[idx]) {
+            std::memcpy(out, &mtx.redo[off], len);
+            out += len;
+        }
+        off += len;
+    }
+
+    LogRecordHeader rh;
+    rh.lsn = lsn;
+    rh.size = size;
+    rh.checksum = crc32(payload, size);
+    std::memcpy(&buffer[start], &rh, sizeof(rh));
+
+    next_lsn = end;
+    mtx.end_lsn = end;
+}
+
+
+void LogManager::flush(long long lsn) {
+    std::unique_lock<std::mutex> lk(mutex);
+
+    while (flushed_lsn < lsn) {
+        if (flushing) {
+            flushed_cv.wait(lk);
+            continue;
+        }
+
+        flushing = true;
+        std::vector<char> out;
+        out.swap(buffer);
+        long long start = buffer_lsn;
+        long long end = next_lsn;
+        buffer_lsn = end;
+        lk.unlock();
+
+        if (!out.empty() && pwrite(fd, out.data(), out.size(), offsetOf(start)) != (ssize_t)out.size()) {
+            perror("WAL Write Failed");
+            exit(1);
+        }
+        fdatasync(fd);
+
+        lk.lock();
+        flushed_lsn = end;
+        flushing = false;
+        flushed_cv.notify_all();
+    }
+}
+
+
+bool LogManager::readRecord(long long& lsn, std::vector<char>& payload) {
+    LogRecordHeader rh;
+    if (pread(fd, &rh, sizeof(rh), offsetOf(lsn)) != (ssize_t)sizeof(rh)) return false;
+    if (rh.lsn != lsn || rh.size <= 0 || rh.size > MAX_LOG_RECORD) return false;
+
+    payload.resize(rh.size);
+    if (pread(fd, payload.data(), rh.size, offsetOf(lsn) + sizeof(rh)) != rh.size) return false;
+    if (crc32(payload.data(), rh.size) != rh.checksum) return false;
+
+    lsn += sizeof(rh) + rh.size;
+
+    std::lock_guard<std::mutex> lk(mutex);
+    buffer_lsn = next_lsn = flushed_lsn = lsn;
+    return true;
+}
+
+
+void LogManager::startAt(long long lsn) {
+    std::lock_guard<std::mutex> lk(mutex);
+
+    buffer.clear();
+    buffer_lsn = next_lsn = flushed_lsn = lsn;
+    if (ftruncate(fd, offsetOf(lsn)) != 0) { perror("WAL Truncate Failed"); exit(1); }
+}
+
+
+void LogManager::reset() {
+    std::lock_guard<std::mutex> lk(mutex);
+
+    buffer.clear();
+    base_lsn = checkpoint_lsn = image_lsn = next_lsn;
+    buffer_lsn = flushed_lsn = next_lsn;
+
+    if (ftruncate(fd, WAL_HEADER_SIZE) != 0) { perror("WAL Truncate Failed"); exit(1); }
+    writeHeader();
+}
+
+
+long long LogManager::beginCheckpoint() {
+    std::lock_guard<std::mutex> lk(mutex);
+    image_lsn = next_lsn;
+    return next_lsn;
+}
+
+
+void LogManager::endCheckpoint(long long redo_lsn) {
+    off_t old_start;
+    {
+        std::lock_guard<std::mutex> lk(mutex);
+        old_start = offsetOf(checkpoint_lsn);
+        checkpoint_lsn = redo_lsn;
+        writeHeader();
+    }
+
+    off_t from = std::max((off_t)WAL_HEADER_SIZE, old_start / page_size * page_size);
+    off_t to = offsetOf(redo_lsn) / page_size * page_size;
+    if (to > from) fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, from, to - from);
+}
+
+
+long long LogManager::sinceCheckpoint() {
+    std::lock_guard<std::mutex> lk(mutex);
+    return next_lsn - checkpoint_lsn;
+}
@@ -0,0 +1,111 @@
+#ifndef LOG_MANAGER_H
+#define LOG_MANAGER_H
+
+#include "common.h"
+#include "BufferPool.h"
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+
+enum LogType {
+    LOG_PAGE_IMAGE = 1,
+    LOG_PAGE_BYTES = 2,
+    LOG_LEAF_INSERT = 3,
+    LOG_LEAF_DELETE = 4,
+    LOG_LEAF_SPLIT = 5,
+    LOG_INTERNAL_INSERT = 6,
+    LOG_INTERNAL_SPLIT = 7,
+    LOG_VAR_INSERT = 9,
+    LOG_VAR_DELETE = 10
+};
+
+struct WalHeader {
+    int magic;
+    int version;
+    long long base_lsn;
+    long long checkpoint_lsn;
+};
+
+struct LogRecordHeader {
+    long long lsn;
+    int size;
+    unsigned int checksum;
+};
+
+struct LogEntryHeader {
+    int type;
+    PageId page_id;
+    int len;
+};
+
+struct LoggedPage {
+    Page* page;
+    bool image;
+};
+
+class MiniTxn {
+    std::vector<LoggedPage> pages;
+    std::vector<char> redo;
+    std::vector<PageGuard> held;
+    std::vector<PageId> freed;
+    long long end_lsn;
+
+    friend class LogManager;
+public:
+    MiniTxn() : end_lsn(0) {}
+
+    void add(Page* p, int type, const void* data, int len);
+    void logImage(Page* p);
+    void logBytes(Page* p, int offset, int len);
+
+    void hold(PageGuard&& g) { held.push_back(std::move(g)); }
+    void releasePages() { held.clear(); }
+
+    void freePage(PageId page_id) { freed.push_back(page_id); }
+    const std::vector<PageId>& freedPages() const { return freed; }
+
+    bool empty() const { return pages.empty(); }
+    long long lsn() const { return end_lsn; }
+};
+
+// Redo for the entry types every page understands; node-level entries are left to the index's
+// own redo function and reported as unhandled.
+bool redoPageEntry(Page* p, const LogEntryHeader* e, const char* data);
+
+class LogManager {
+    int fd;
+    int page_size;
+
+    std::mutex mutex;
+    std::condition_variable flushed_cv;
+    std::vector<char> buffer;
+    long long buffer_lsn;
+    long long next_lsn;
+    long long flushed_lsn;
+    bool flushing;
+
+    long long base_lsn;
+    long long checkpoint_lsn;
+    long long image_lsn;
+
+    off_t offsetOf(long long lsn) const { return WAL_HEADER_SIZE + (lsn - base_lsn); }
+    void writeHeader();
+public:
+    LogManager(const char* path, int page_size);
+    ~LogManager();
+
+    void commit(MiniTxn& mtx);
+    void flush(long long lsn);
+
+    bool readRecord(long long& lsn, std::vector<char>& payload);
+    void startAt(long long lsn);
+    void reset();
+
+    long long beginCheckpoint();
+    void endCheckpoint(long long redo_lsn);
+
+    long long checkpointLsn() const { return checkpoint_lsn; }
+    long long sinceCheckpoint();
+};
+
+#endif
@@ -0,0 +1,260 @@
+#ifndef NODE_H
+#define NODE_H
+
+#include "TreeTraits.h"
+#include "KeySearch.h"
+#include "PackedLeaf.h"
+#include <algorithm>
+#include <type_traits>
+
+// The key range [low, high) a node is responsible for at its level, kept right after the page
+// header of leaves and internal nodes alike. The leftmost node of a level has no low fence and the
+// rightmost one, which has no right link, no high fence. A split hands the upper part of the range
+// to the new right sibling, so a descent that finds its key at or above the high fence follows the
+// right link.
+template <typename T>
+class NodeFences {
+    typedef typename T::Key Key;
+
+    Page* page;
+
+    Key* keys() const { return reinterpret_cast<Key*>(page->data + lowOffset()); }
+public:
+    explicit NodeFences(Page* p) : page(p) {}
+
+    bool hasLow() const { return page->getHeader()->flags & PAGE_LOW_FENCE; }
+    bool hasHigh() const { return page->getHeader()->right_link != INVALID_PAGE_ID; }
+    Key low() const { return keys()[0]; }
+    Key high() const { return keys()[1]; }
+    static int lowOffset() { return sizeof(PageHeader); }
+    static int highOffset() { return sizeof(PageHeader) + sizeof(Key); }
+
+    // With strict set, k is an exclusive upper bound and the node must hold keys just below it.
+    bool aboveLow(const Key& k, bool strict = false) const {
+        return !hasLow() || (strict ? T::less(low(), k) : !T::less(k, low()));
+    }
+    bool belowHigh(const Key& k, bool strict = false) const {
+        return !hasHigh() || (strict ? !T::less(high(), k) : T::less(k, high()));
+    }
+
+    void setLow(const Key& k) {
+        keys()[0] = k;
+        page->getHeader()->flags |= PAGE_LOW_FENCE;
+    }
+    void setHigh(const Key& k, PageId right_link) {
+        keys()[1] = k;
+        page->getHeader()->right_link = right_link;
+    }
+    void takeHigh(const NodeFences& from) { setHigh(from.high(), from.page->getHeader()->right_link); }
+};
+
+template <typename T>
+class BasicLeafNode {
+    typedef typename T::Key Key;
+    typedef typename T::LeafEntry LeafEntry;
+    typedef KeySearch<Key, typename T::KeyCompare> Search;
+
+    Page* page;
+
+    static bool entryLess(const LeafEntry& a, const LeafEntry& b) { return T::less(a.key, b.key); }
+public:
+    explicit BasicLeafNode(Page* p) : page(p) {}
+
+    static int fillCount(const LeafEntry*, int n, double fill) { return std::min(n, std::max(T::MIN_LEAF_ITEMS, (int)(T::LEAF_CAPACITY * fill))); }
+    static int splitPoint(const LeafEntry*, int n) { return n / 2; }
+
+    PageHeader* header() const { return page->getHeader(); }
+    int size() const { return page->getHeader()->num_items; }
+    int sortedSize() const { return size() - page->getHeader()->unsorted_items; }
+
+    Key* keys() const { return reinterpret_cast<Key*>(page->data + T::NODE_HEADER); }
+    Key key(int i) const { return keys()[i]; }
+    char* value(int i) const { return page->data + T::LEAF_VALUES_OFFSET + (size_t)i * T::VALUE_SIZE; }
+
+    int lowerBound(const Key& k) const { return Search::lowerBound(keys(), sortedSize(), k); }
+
+    // Requests the header and the first probes of a search; nothing on the page is read.
+    void prefetch() const {
+        __builtin_prefetch(page->data);
+        __builtin_prefetch(keys() + T::LEAF_CAPACITY / 4);
+        __builtin_prefetch(keys() + T::LEAF_CAPACITY / 2);
+    }
+
+    int find(const Key& k) const {
+        int s = sortedSize();
+        int i = Search::lowerBound(keys(), s, k);
+        if (i < s && !T::less(k, key(i))) return i;
+
+        for (i = s; i < size(); i++) {
+            if (T::equal(key(i), k)) return i;
+        }
+        return -1;
+    }
+
+    int sortedOrder(int* order) const {
+        int n = size();
+        int s = sortedSize();
+        for (int i = 0; i < n; i++) order[i] = i;
+        if (s == n) return n;
+
+        const Key* k = keys();
+        std::sort(order + s, order + n, [k](int a, int b) { return T::less(k[a], k[b]); });
+        std::inplace_merge(order, order + s, order + n, [k](int a, int b) { return T::less(k[a], k[b]); });
+        return n;
+    }
+
+    void copyValue(int i, char* out) const { std::memcpy(out, value(i), T::VALUE_SIZE); }
+
+    LeafEntry entry(int i) const {
+        LeafEntry e;
+        e.key = key(i);
+        copyValue(i, e.data);
+        return e;
+    }
+
+    bool full() const { return size() >= T::LEAF_CAPACITY; }
+    bool atMinimum() const { return size() <= T::MIN_LEAF_ITEMS; }
+
+    void init() {
+        header()->num_items = 0;
+        header()->unsorted_items = 0;
+    }
+
+    void set(int i, const Key& k, const char* val) {
+        keys()[i] = k;
+        std::memcpy(value(i), val, T::VALUE_SIZE);
+    }
+
+    bool insertAt(int i, const Key& k, const char* val) {
+        int n = size();
+        std::memmove(keys() + i + 1, keys() + i, (n - i) * sizeof(Key));
+        std::memmove(value(i + 1), value(i), (size_t)(n - i) * T::VALUE_SIZE);
+        set(i, k, val);
+        header()->num_items = n + 1;
+        return true;
+    }
+
+    bool insert(const Key& k, const char* val) {
+        int n = size();
+        int u = header()->unsorted_items;
+        if (n >= T::LEAF_CAPACITY) return false;
+
+        if (LEAF_APPEND_SLOTS == 0 || (u == 0 && (n == 0 || T::less(key(n - 1), k)))) {
+            normalize();
+            insertAt(lowerBound(k), k, val);
+            return true;
+        }
+
+        if (u >= LEAF_APPEND_SLOTS) normalize();
+        set(size(), k, val);
+        header()->num_items++;
+        header()->unsorted_items++;
+        return true;
+    }
+
+    void removeAt(int i) {
+        int n = size();
+        if (i >= sortedSize()) header()->unsorted_items--;
+        std::memmove(keys() + i, keys() + i + 1, (n - i - 1) * sizeof(Key));
+        std::memmove(value(i), value(i + 1), (size_t)(n - i - 1) * T::VALUE_SIZE);
+        header()->num_items = n - 1;
+    }
+
+    void truncate(int n) {
+        header()->num_items = n;
+        header()->unsorted_items = 0;
+    }
+
+    void normalize() {
+        int n = size();
+        int s = sortedSize();
+        if (s == n) return;
+
+        LeafEntry buf[T::LEAF_CAPACITY];
+        for (int i = 0; i < n; i++) buf[i] = entry(i);
+        std::sort(buf + s, buf + n, entryLess);
+        std::inplace_merge(buf, buf + s, buf + n, entryLess);
+        assign(buf, n);
+    }
+
+    void assign(const LeafEntry* entries, int n) {
+        for (int i = 0; i < n; i++) set(i, entries[i].key, entries[i].data);
+        header()->num_items = n;
+        header()->unsorted_items = 0;
+    }
+
+    void append(const BasicLeafNode& src) {
+        int n = size();
+        std::memcpy(keys() + n, src.keys(), src.size() * sizeof(Key));
+        std::memcpy(value(n), src.value(0), (size_t)src.size() * T::VALUE_SIZE);
+        header()->num_items = n + src.size();
+    }
+};
+
+template <typename T>
+class BasicInternalNode {
+    typedef typename T::Key Key;
+    typedef typename T::InternalEntry InternalEntry;
+    typedef KeySearch<Key, typename T::KeyCompare> Search;
+
+    Page* page;
+public:
+    explicit BasicInternalNode(Page* p) : page(p) {}
+
+    PageHeader* header() const { return page->getHeader(); }
+    int size() const { return page->getHeader()->num_items; }
+
+    Key* keys() const { return reinterpret_cast<Key*>(page->data + T::NODE_HEADER); }
+    PageId* ptrs() const { return reinterpret_cast<PageId*>(page->data + T::INTERNAL_PTRS_OFFSET); }
+    Key key(int i) const { return keys()[i]; }
+    PageId ptr(int i) const { return ptrs()[i]; }
+
+    int lowerBound(const Key& k) const { return Search::lowerBound(keys(), size(), k); }
+    int upperBound(const Key& k) const { return Search::upperBound(keys(), size(), k); }
+
+    // A node is between half and fully occupied, so the first binary search probe lands between
+    // these two key lines.
+    void prefetch() const {
+        __builtin_prefetch(page->data);
+        __builtin_prefetch(keys() + T::INTERNAL_CAPACITY / 4);
+        __builtin_prefetch(keys() + T::INTERNAL_CAPACITY / 2);
+    }
+
+    InternalEntry entry(int i) const {
+        InternalEntry e = { key(i), ptr(i) };
+        return e;
+    }
+
+    void set(int i, const Key& k, PageId p) {
+        keys()[i] = k;
+        ptrs()[i] = p;
+    }
+
+    void insertAt(int i, const Key& k, PageId p) {
+        int n = size();
+        std::memmove(keys() + i + 1, keys() + i, (n - i) * sizeof(Key));
+        std::memmove(ptrs() + i + 1, ptrs() + i, (n - i) * sizeof(PageId));
+        set(i, k, p);
+        header()->num_items = n + 1;
+    }
+
+    void removeAt(int i) {
+        int n = size();
+        std::memmove(keys() + i, keys() + i + 1, (n - i - 1) * sizeof(Key));
+        std::memmove(ptrs() + i, ptrs() + i + 1, (n - i - 1) * sizeof(PageId));
+        header()->num_items = n - 1;
+    }
+
+    void assign(const InternalEntry* entries, int n) {
+        for (int i = 0; i < n; i++) set(i, entries[i].key, entries[i].ptr);
+        header()->num_items = n;
+    }
+};
+
+// Leaf layout for a tree shape: the packed format when the traits ask for it, plain arrays otherwise.
+template <typename T>
+struct LeafNodeOf {
+    typedef typename std::conditional<T::PACKED_LEAVES, PackedLeafNode<T>, BasicLeafNode<T> >::type type;
+};
+
+#endif
@@ -0,0 +1,359 @@
+#ifndef PACKED_LEAF_H
+#define PACKED_LEAF_H
+
+#include "common.h"
+#include "Compression.h"
+#include <algorithm>
+#include <iostream>
+#include <cstdlib>
+#include <type_traits>
+
+// Leaf keys are stored frame-of-reference: one base key plus fixed-width bit-packed deltas, so
+// lowerBound searches the packed form directly. Values are LZ-compressed per tuple into cells
+// growing down from the page end (raw when compression does not pay), addressed by a uint16
+// offset array that follows the packed keys.
+
+template <typename K>
+struct PackedLeafHeader {
+    K base;
+    uint16_t key_bits;
+    uint16_t heap_start;
+    uint16_t garbage;
+    uint16_t reserved;
+};
+
+const uint16_t PACKED_RAW = 0x8000;
+
+template <typename K>
+inline int keyBits(K lo, K hi) {
+    typedef typename std::make_unsigned<K>::type Delta;
+    uint64_t range = (Delta)hi - (Delta)lo;
+    return range == 0 ? 0 : 64 - __builtin_clzll(range);
+}
+
+inline int packedKeyBytes(int n, int bits) { return (n * bits + 7) / 8; }
+
+inline int encodeValue(const char* val, int size, char* cell) {
+    int len = lzCompress(val, size, cell + sizeof(uint16_t), size - 1);
+    uint16_t hdr = len;
+
+    if (len < 0) {
+        std::memcpy(cell + sizeof(uint16_t), val, size);
+        len = size;
+        hdr = size | PACKED_RAW;
+    }
+    std::memcpy(cell, &hdr, sizeof(hdr));
+    return sizeof(uint16_t) + len;
+}
+
+template <typename T>
+class PackedLeafNode {
+    typedef typename T::Key Key;
+    typedef typename T::LeafEntry LeafEntry;
+    typedef typename std::make_unsigned<Key>::type KeyDelta;
+    typedef PackedLeafHeader<Key> Header;
+
+    static const int KEYS_OFFSET = T::NODE_HEADER + sizeof(Header);
+    static const int LEAF_SPACE = T::PAGE - KEYS_OFFSET;
+    static const int CELL_MAX = sizeof(uint16_t) + T::VALUE_SIZE;
+    static const int KEY_DELTA_BITS = sizeof(KeyDelta) * 8;
+    static const int MAX_ITEMS = T::LEAF_MAX_ITEMS;
+
+    Page* page;
+
+    static KeyDelta keyMask(int bits) { return bits == KEY_DELTA_BITS ? (KeyDelta)~(KeyDelta)0 : ((KeyDelta)1 << bits) - 1; }
+    static int offsetsStart(int n, int bits) { return KEYS_OFFSET + ((packedKeyBytes(n, bits) + 1) & ~1); }
+    static int encode(const char* val, char* cell) { return encodeValue(val, T::VALUE_SIZE, cell); }
+
+    Header* packed() const { return reinterpret_cast<Header*>(page->data + T::NODE_HEADER); }
+    const unsigned char* keyArea() const { return reinterpret_cast<const unsigned char*>(page->data + KEYS_OFFSET); }
+    uint16_t* offsets() const { return reinterpret_cast<uint16_t*>(page->data + offsetsStart(size(), packed()->key_bits)); }
+
+    const char* cell(int i) const { return page->data + offsets()[i]; }
+
+    static int cellHeader(const char* c) {
+        uint16_t hdr;
+        std::memcpy(&hdr, c, sizeof(hdr));
+        return hdr;
+    }
+
+    static int cellSize(const char* c) { return sizeof(uint16_t) + (cellHeader(c) & ~PACKED_RAW); }
+
+    KeyDelta delta(int i) const {
+        int bits = packed()->key_bits;
+        if (bits == 0) return 0;
+
+        size_t bit = (size_t)i * bits;
+        int shift = bit & 7;
+        uint64_t w;
+        std::memcpy(&w, keyArea() + (bit >> 3), sizeof(w));
+        w >>= shift;
+        if (KEY_DELTA_BITS == 64 && shift + bits > 64) w |= (uint64_t)keyArea()[(bit >> 3) + 8] << (64 - shift);
+        return (KeyDelta)w & keyMask(bits);
+    }
+
+    void load(Key* k, uint16_t* offs, int n) const {
+        const uint16_t* o = offsets();
+        for (int i = 0; i < n; i++) {
+            k[i] = key(i);
+            offs[i] = o[i];
+        }
+    }
+
+    void pack(const Key* k, const uint16_t* offs, int n) {
+        Header* ph = packed();
+        int bits = n > 0 ? keyBits(k[0], k[n - 1]) : 0;
+        ph->base = n > 0 ? k[0] : 0;
+        ph->key_bits = bits;
+
+        unsigned char* dst = reinterpret_cast<unsigned char*>(page->data + KEYS_OFFSET);
+        std::memset(dst, 0, packedKeyBytes(n, bits));
+
+        for (int i = 0; bits > 0 && i < n; i++) {
+            size_t bit = (size_t)i * bits;
+            int shift = bit & 7;
+            uint64_t d = (KeyDelta)k[i] - (KeyDelta)k[0];
+            uint64_t w;
+            std::memcpy(&w, dst + (bit >> 3), sizeof(w));
+            w |= d << shift;
+            std::memcpy(dst + (bit >> 3), &w, sizeof(w));
+            if (KEY_DELTA_BITS == 64 && shift + bits > 64) dst[(bit >> 3) + 8] |= d >> (64 - shift);
+        }
+
+        std::memcpy(page->data + offsetsStart(n, bits), offs, n * sizeof(uint16_t));
+        header()->num_items = n;
+
+        if (n == 0) {
+            ph->heap_start = T::PAGE;
+            ph->garbage = 0;
+        }
+    }
+
+    int placeCell(const char* c, int len) {
+        Header* ph = packed();
+        int off = ph->heap_start - len;
+        std::memcpy(page->data + off, c, len);
+        ph->heap_start = off;
+        return off;
+    }
+
+    bool insertCell(int i, Key k, const char* c, int len) {
+        int n = size();
+        if (n >= MAX_ITEMS) return false;
+
+        Key lo = i == 0 ? k : key(0);
+        Key hi = i == n ? k : key(n - 1);
+        int end = offsetsStart(n + 1, keyBits(lo, hi)) + (n + 1) * (int)sizeof(uint16_t);
+
+        Header* ph = packed();
+        if (end + len > ph->heap_start + ph->garbage) return false;
+        if (end + len > ph->heap_start) compact();
+
+        Key keys[MAX_ITEMS + 1];
+        uint16_t offs[MAX_ITEMS + 1];
+        load(keys, offs, n);
+
+        std::memmove(keys + i + 1, keys + i, (n - i) * sizeof(Key));
+        std::memmove(offs + i + 1, offs + i, (n - i) * sizeof(uint16_t));
+        keys[i] = k;
+        offs[i] = placeCell(c, len);
+
+        pack(keys, offs, n + 1);
+        return true;
+    }
+
+    void compact() {
+        Header* ph = packed();
+        if (ph->garbage == 0) return;
+
+        char buf[T::PAGE];
+        int top = T::PAGE;
+        uint16_t* o = offsets();
+
+        for (int i = 0; i < size(); i++) {
+            int len = cellSize(page->data + o[i]);
+            top -= len;
+            std::memcpy(buf + top, page->data + o[i], len);
+            o[i] = top;
+        }
+        std::memcpy(page->data + top, buf + top, T::PAGE - top);
+        ph->heap_start = top;
+        ph->garbage = 0;
+    }
+public:
+    explicit PackedLeafNode(Page* p) : page(p) {}
+
+    static int fillCount(const LeafEntry* entries, int n, double fill) {
+        int budget = std::max(LEAF_SPACE / 2, (int)(LEAF_SPACE * fill));
+        char c[CELL_MAX];
+        int used = 0;
+        int m = 0;
+
+        for (; m < n && m < MAX_ITEMS; m++) {
+            int len = encode(entries[m].data, c);
+            int key_bytes = offsetsStart(m + 1, keyBits(entries[0].key, entries[m].key)) - KEYS_OFFSET;
+            if (key_bytes + (m + 1) * (int)sizeof(uint16_t) + used + len > budget) break;
+            used += len;
+        }
+        return std::max(m, 1);
+    }
+
+    static int splitPoint(const LeafEntry* entries, int n) {
+        int sizes[MAX_ITEMS + 1];
+        char c[CELL_MAX];
+        int total = 0;
+
+        for (int i = 0; i < n; i++) {
+            sizes[i] = sizeof(Key) + sizeof(uint16_t) + encode(entries[i].data, c);
+            total += sizes[i];
+        }
+
+        int mid = 0;
+        for (int acc = 0; mid < n && 2 * acc < total; mid++) acc += sizes[mid];
+        return std::min(std::max(mid, std::max(1, n - MAX_ITEMS)), std::min(n - 1, MAX_ITEMS));
+    }
+
+    PageHeader* header() const { return page->getHeader(); }
+    int size() const { return page->getHeader()->num_items; }
+    int sortedSize() const { return size(); }
+
+    Key key(int i) const { return (Key)((KeyDelta)packed()->base + delta(i)); }
+
+    int lowerBound(Key k) const {
+        int n = size();
+        if (n == 0 || k <= packed()->base) return 0;
+
+        KeyDelta t = (KeyDelta)k - (KeyDelta)packed()->base;
+        if (t > keyMask(packed()->key_bits)) return n;
+
+        int lo = 0, hi = n;
+        while (lo < hi) {
+            int mid = (lo + hi) / 2;
+            if (delta(mid) < t) lo = mid + 1;
+            else hi = mid;
+        }
+        return lo;
+    }
+
+    // The key area's size depends on the header, so only the header and the start of the deltas
+    // are requested.
+    void prefetch() const {
+        __builtin_prefetch(page->data);
+        __builtin_prefetch(keyArea() + 64);
+    }
+
+    int find(Key k) const {
+        int i = lowerBound(k);
+        return i < size() && key(i) == k ? i : -1;
+    }
+
+    int sortedOrder(int* order) const {
+        int n = size();
+        for (int i = 0; i < n; i++) order[i] = i;
+        return n;
+    }
+
+    void copyValue(int i, char* out) const {
+        const char* c = cell(i);
+        int hdr = cellHeader(c);
+
+        if (hdr & PACKED_RAW) {
+            std::memcpy(out, c + sizeof(uint16_t), T::VALUE_SIZE);
+            return;
+        }
+        if (!lzDecompress(c + sizeof(uint16_t), hdr, out, T::VALUE_SIZE)) {
+            std::cerr << "corrupt leaf value on page " << header()->page_id << std::endl;
+            exit(1);
+        }
+    }
+
+    LeafEntry entry(int i) const {
+        LeafEntry e;
+        e.key = key(i);
+        copyValue(i, e.data);
+        return e;
+    }
+
+    int freeSpace() const {
+        return packed()->heap_start - offsetsStart(size(), packed()->key_bits) - size() * (int)sizeof(uint16_t) + packed()->garbage;
+    }
+
+    int rawBytes() const { return size() * (int)(sizeof(Key) + sizeof(uint16_t)) + T::PAGE - packed()->heap_start - packed()->garbage; }
+
+    bool full() const {
+        int n = size();
+        return n >= MAX_ITEMS || offsetsStart(n + 1, KEY_DELTA_BITS) + (n + 1) * (int)sizeof(uint16_t) + CELL_MAX > packed()->heap_start + packed()->garbage;
+    }
+
+    bool atMinimum() const { return rawBytes() <= LEAF_SPACE / 2; }
+
+    void init() {
+        header()->num_items = 0;
+        header()->unsorted_items = 0;
+        packed()->base = 0;
+        packed()->key_bits = 0;
+        packed()->heap_start = T::PAGE;
+        packed()->garbage = 0;
+    }
+
+    bool insertAt(int i, Key k, const char* val) {
+        char c[CELL_MAX];
+        int len = encode(val, c);
+        return insertCell(i, k, c, len);
+    }
+
+    bool insert(Key k, const char* val) { return insertAt(lowerBound(k), k, val); }
+
+    void removeAt(int i) {
+        int n = size();
+        Key keys[MAX_ITEMS];
+        uint16_t offs[MAX_ITEMS];
+        load(keys, offs, n);
+
+        packed()->garbage += cellSize(page->data + offs[i]);
+        std::memmove(keys + i, keys + i + 1, (n - i - 1) * sizeof(Key));
+        std::memmove(offs + i, offs + i + 1, (n - i - 1) * sizeof(uint16_t));
+        pack(keys, offs, n - 1);
+    }
+
+    void truncate(int m) {
+        int n = size();
+        Key keys[MAX_ITEMS];
+        uint16_t offs[MAX_ITEMS];
+        load(keys, offs, n);
+
+        for (int i = m; i < n; i++) packed()->garbage += cellSize(page->data + offs[i]);
+        pack(keys, offs, m);
+    }
+
+    void normalize() {}
+
+    void assign(const LeafEntry* entries, int n) {
+        init();
+
+        Key keys[MAX_ITEMS];
+        uint16_t offs[MAX_ITEMS];
+        char c[CELL_MAX];
+
+        for (int i = 0; i < n; i++) {
+            keys[i] = entries[i].key;
+            offs[i] = placeCell(c, encode(entries[i].data, c));
+        }
+        pack(keys, offs, n);
+    }
+
+    void append(const PackedLeafNode& src) {
+        for (int i = 0; i < src.size(); i++) {
+            const char* c = src.cell(i);
+            insertCell(size(), src.key(i), c, cellSize(c));
+        }
+    }
+};
+
+template <typename T> const int PackedLeafNode<T>::KEYS_OFFSET;
+template <typename T> const int PackedLeafNode<T>::LEAF_SPACE;
+template <typename T> const int PackedLeafNode<T>::CELL_MAX;
+template <typename T> const int PackedLeafNode<T>::KEY_DELTA_BITS;
+template <typename T> const int PackedLeafNode<T>::MAX_ITEMS;
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef TREE_TRAITS_H
+#define TREE_TRAITS_H
+
+#include "common.h"
+#include <functional>
+#include <type_traits>
+
+#ifdef BPT_PACKED_LEAVES
+const bool DEFAULT_PACKED_LEAVES = true;
+#else
+const bool DEFAULT_PACKED_LEAVES = false;
+#endif
+
+// Shape of one B+ tree: key type and order, value size, page size and leaf format. Node
+// capacities and offsets are compile-time constants, so each shape gets its own specialized code.
+template <typename K, int VALUE_BYTES = TUPLE_SIZE, int PAGE_BYTES = PAGE_SIZE, typename Compare = std::less<K>, bool PACKED = DEFAULT_PACKED_LEAVES>
+struct TreeTraits {
+    typedef K Key;
+    typedef Compare KeyCompare;
+
+    struct LeafEntry {
+        K key;
+        char data[VALUE_BYTES];
+    };
+
+    struct InternalEntry {
+        K key;
+        PageId ptr;
+    };
+
+    static const int VALUE_SIZE = VALUE_BYTES;
+    static const int PAGE = PAGE_BYTES;
+    static const bool PACKED_LEAVES = PACKED;
+
+    // Page header followed by the node's low and high fence keys.
+    static const int NODE_HEADER = sizeof(PageHeader) + 2 * sizeof(K);
+
+    static const int LEAF_CAPACITY = (PAGE_BYTES - NODE_HEADER) / (sizeof(K) + VALUE_BYTES);
+    static const int INTERNAL_SLOTS = (PAGE_BYTES - NODE_HEADER) / (sizeof(K) + sizeof(PageId));
+    static const int INTERNAL_CAPACITY = sizeof(PageId) > sizeof(K) ? INTERNAL_SLOTS & ~1 : INTERNAL_SLOTS;
+
+    static const int LEAF_VALUES_OFFSET = NODE_HEADER + LEAF_CAPACITY * sizeof(K);
+    static const int INTERNAL_PTRS_OFFSET = NODE_HEADER + INTERNAL_CAPACITY * sizeof(K);
+
+    static const int MIN_LEAF_ITEMS = LEAF_CAPACITY / 2;
+    static const int MIN_INTERNAL_ITEMS = INTERNAL_CAPACITY / 2;
+    static const int LEAF_MAX_ITEMS = PACKED ? PAGE_BYTES / 8 : LEAF_CAPACITY;
+
+    static bool less(const K& a, const K& b) { return Compare()(a, b); }
+    static bool equal(const K& a, const K& b) { return !less(a, b) && !less(b, a); }
+
+    static_assert(std::is_trivially_copyable<K>::value, "keys are stored by memcpy");
+    static_assert(PAGE_BYTES >= 512 && PAGE_BYTES <= MAX_PAGE_SIZE && (PAGE_BYTES & (PAGE_BYTES - 1)) == 0, "page size must be a power of two up to MAX_PAGE_SIZE");
+    static_assert(LEAF_CAPACITY >= 4 && INTERNAL_CAPACITY >= 4, "page too small for this key and value size");
+    static_assert(!PACKED || (std::is_integral<K>::value && std::is_same<Compare, std::less<K> >::value), "packed leaves need integer keys in ascending order");
+    static_assert(!PACKED || PAGE_BYTES <= 32768, "packed cell offsets are 15-bit");
+    static_assert(!PACKED || LEAF_APPEND_SLOTS == 0, "packed leaves keep no unsorted tail");
+};
+
+template <typename K, int V, int P, typename C, bool PK> const int TreeTraits<K, V, P, C, PK>::VALUE_SIZE;
+template <typename K, int V, int P, typename C, bool PK> const int TreeTraits<K, V, P, C, PK>::PAGE;
+template <typename K, int V, int P, typename C, bool PK> const bool TreeTraits<K, V, P, C, PK>::PACKED_LEAVES;
+template <typename K, int V, int P, typename C, bool PK> const int TreeTraits<K, V, P, C, PK>::NODE_HEADER;
+template <typename K, int V, int P, typename C, bool PK> const int TreeTraits<K, V, P, C, PK>::LEAF_CAPACITY;
+template <typename K, int V, int P, typename C, bool PK> const int TreeTraits<K, V, P, C, PK>::INTERNAL_SLOTS;
+template <typename K, int V, int P, typename C, bool PK> const int TreeTraits<K, V, P, C, PK>::INTERNAL_CAPACITY;
+template <typename K, int V, int P, typename C, bool PK> const int TreeTraits<K, V, P, C, PK>::LEAF_VALUES_OFFSET;
+template <typename K, int V, int P, typename C, bool PK> const int TreeTraits<K, V, P, C, PK>::INTERNAL_PTRS_OFFSET;
+template <typename K, int V, int P, typename C, bool PK> const int TreeTraits<K, V, P, C, PK>::MIN_LEAF_ITEMS;
+template <typename K, int V, int P, typename C, bool PK> const int TreeTraits<K, V, P, C, PK>::MIN_INTERNAL_ITEMS;
+template <typename K, int V, int P, typename C, bool PK> const int TreeTraits<K, V, P, C, PK>::LEAF_MAX_ITEMS;
+
+typedef TreeTraits<KeyType> DefaultTreeTraits;
+
+#endif
@@ -0,0 +1,544 @@
+#include "VarBPlusTree.h"
+#include <iostream>
+#include <algorithm>
+
+#include <vector>
+#include <cstdlib>
+
+const int SPLIT_WINDOW_DIV = 8;
+
+struct SplitEntry {
+    std::string key;
+    const char* val;
+    int val_len;
+};
+
+
+static std::vector<SplitEntry> withEntry(const VarNode& node, int idx, const std::string& key, const char* val, int val_len) {
+    std::vector<SplitEntry> out;
+    out.reserve(node.size() + 1);
+
+    for (int i = 0; i <= node.size(); i++) {
+        if (i == idx) {
+            SplitEntry e = { key, val, val_len };
+            out.push_back(e);
+        }
+        if (i == node.size()) break;
+
+        SplitEntry e = { node.fullKey(i), node.value(i), node.valueLen(i) };
+        out.push_back(e);
+    }
+
+    return out;
+}
+
+
+static int separatorLength(const std::string& left, const std::string& right) {
+    int lcp = commonPrefix(left.data(), left.size(), right.data(), right.size());
+    return std::min<int>(lcp + 1, right.size());
+}
+
+
+// Picks where to split `entries`: entries [0, m) stay left and entries from m (or m + 1 when
+// the separator moves up) go right. Among the split points that keep both halves within a page
+// and within total / SPLIT_WINDOW_DIV bytes of the midpoint, the one with the shortest separator wins.
+static int chooseSplit(const std::vector<SplitEntry>& entries, int prefix_len, bool promote, int& sep_len) {
+    int n = entries.size();
+    std::vector<int> acc(n + 1, 0);
+    for (int i = 0; i < n; i++) acc[i + 1] = acc[i] + VarNode::entrySize(entries[i].key.size() - prefix_len, entries[i].val_len);
+
+    int total = acc[n];
+    int window = total / SPLIT_WINDOW_DIV;
+    int best = -1;
+    long long best_rank = 0;
+    sep_len = 0;
+
+    for (int m = 1; m < n - (promote ? 1 : 0); m++) {
+        int left = acc[m];
+        int right = total - acc[promote ? m + 1 : m];
+        if (left + prefix_len > VAR_PAGE_SPACE || right + prefix_len > VAR_PAGE_SPACE) continue;
+
+        int dist = std::abs(2 * left - total);
+        int len = promote ? entries[m].key.size() : separatorLength(entries[m - 1].key, entries[m].key);
+        long long rank = dist <= 2 * window ? (long long)len * PAGE_SIZE * 2 + dist : (long long)PAGE_SIZE * PAGE_SIZE + dist;
+
+        if (best < 0 || rank < best_rank) {
+            best = m;
+            best_rank = rank;
+            sep_len = len;
+        }
+    }
+    return best;
+}
+
+
+static void fillNode(VarNode& node, const std::vector<SplitEntry>& entries, int from, int to) {
+    for (int i = from; i < to; i++) node.insertAt(i - from, entries[i].key.data(), entries[i].key.size(), entries[i].val, entries[i].val_len);
+}
+
+
+VarBPlusTree::VarBPlusTree(int pool_frames, const char* path, const char* wal_path, BufferPool* shared_pool) {
+
+    dm = new DiskManager(pool_frames, path, wal_path, PAGE_SIZE, redo, shared_pool);
+    PageGuard meta = dm->getPage(0, LATCH_EXCLUSIVE);
+    PageHeader* mh = meta->getHeader();
+
+
+    if (mh->page_type == PAGE_INVALID) {
+        initPage(meta.get(), 0, PAGE_META, 0);
+
+        MetaPageData* mp = reinterpret_cast<MetaPageData*>(meta->data + sizeof(PageHeader));
+        mp->free_list_head = INVALID_PAGE_ID;
+        mp->free_page_count = 0;
+        mp->page_size = PAGE_SIZE;
+        meta.markDirty();
+        meta.release();
+
+        root_page_id = dm->allocatePage();
+        PageGuard root = dm->newPage(root_page_id);
+        initPage(root.get(), root_page_id, PAGE_LEAF, 0);
+        root.release();
+
+        MiniTxn mtx;
+        updateRoot(mtx, root_page_id);
+        dm->commit(mtx);
+        mtx.releasePages();
+
+        dm->sync();
+
+    } else {
+        MetaPageData* mp = reinterpret_cast<MetaPageData*>(meta->data + sizeof(PageHeader));
+
+        root_page_id = mp->root_page_id;
+    }
+
+}
+
+
+VarBPlusTree::~VarBPlusTree() {
+
+    if (dm) delete dm;
+
+}
+
+
+void VarBPlusTree::flush() { dm->sync(); }
+
+
+void VarBPlusTree::initPage(Page* p, PageId id, int type, int level) {
+    std::memset(p->data, 0, PAGE_SIZE);
+    PageHeader* h = p->getHeader();
+
+    h->page_id = id;
+
+    h->page_type = type;
+    h->level = level;
+
+    h->right_link = INVALID_PAGE_ID;
+    h->extra_ptr = INVALID_PAGE_ID;
+
+    VarNode(p).init();
+}
+
+
+void VarBPlusTree::updateRoot(MiniTxn& mtx, PageId new_root) {
+    root_page_id = new_root;
+    PageGuard meta = dm->getPage(0, LATCH_EXCLUSIVE);
+
+    MetaPageData* mp = reinterpret_cast<MetaPageData*>(meta->data + sizeof(PageHeader));
+
+    mp->root_page_id = root_page_id;
+    meta.markDirty();
+    mtx.logBytes(meta.get(), sizeof(PageHeader), sizeof(MetaPageData));
+    mtx.hold(std::move(meta));
+}
+
+
+void VarBPlusTree::finish(WritePath& path) {
+    dm->commit(path.mtx);
+
+    long long lsn = path.mtx.lsn();
+    path.release();
+
+    if (lsn > 0) dm->waitDurable(lsn);
+}
+
+
+PageId VarBPlusTree::childOf(Page* p, const char* key, int len) {
+    VarNode node(p);
+
+    int idx = node.upperBound(key, len) - 1;
+
+    return idx < 0 ? p->getHeader()->extra_ptr : node.child(idx);
+}
+
+
+PageGuard VarBPlusTree::findLeaf(const char* key, int len, LatchMode leaf_mode) {
+
+    root_latch.lockShared();
+    PageGuard curr = dm->getPage(root_page_id, LATCH_SHARED);
+
+    if (curr->getHeader()->level == 0 && leaf_mode != LATCH_SHARED) {
+        curr.release();
+        curr = dm->getPage(root_page_id, leaf_mode);
+    }
+    root_latch.unlock();
+
+    while (curr->getHeader()->level > 0) {
+
+        int level = curr->getHeader()->level;
+        PageId child = childOf(curr.get(), key, len);
+
+        PageGuard next = dm->getPage(child, level == 1 ? leaf_mode : LATCH_SHARED);
+        curr = std::move(next);
+    }
+
+    return curr;
+}
+
+
+int VarBPlusTree::find(const char* key, int key_len, char* out, int out_cap) {
+
+    PageGuard leaf = findLeaf(key, key_len, LATCH_SHARED);
+
+    VarNode node(leaf.get());
+    int slot = node.find(key, key_len);
+    if (slot < 0) return -1;
+
+    int len = node.valueLen(slot);
+    if (out) std::memcpy(out, node.value(slot), std::min(len, out_cap));
+    return len;
+}
+
+
+bool VarBPlusTree::isSafe(Page* p, int key_len, int val_len) {
+    VarNode node(p);
+
+    if (p->getHeader()->level == 0) return node.fits(key_len, val_len);
+
+    return node.fits(VAR_MAX_KEY_SIZE, sizeof(PageId));
+}
+
+
+void VarBPlusTree::lockPath(const char* key, int key_len, int val_len, WritePath& path) {
+
+    root_latch.lockExclusive();
+    path.root_latch = &root_latch;
+
+    PageGuard node = dm->getPage(root_page_id, LATCH_EXCLUSIVE);
+    if (isSafe(node.get(), key_len, val_len)) path.release();
+    path.nodes.push_back(std::move(node));
+
+    while (path.nodes.back()->getHeader()->level > 0) {
+
+        PageGuard child = dm->getPage(childOf(path.nodes.back().get(), key, key_len), LATCH_EXCLUSIVE);
+        if (isSafe(child.get(), key_len, val_len)) path.release();
+        path.nodes.push_back(std::move(child));
+    }
+}
+
+
+int VarBPlusTree::insertIntoLeaf(MiniTxn& mtx, PageGuard& leaf, const char* key, int key_len, const char* val, int val_len) {
+
+    VarNode node(leaf.get());
+
+    if (node.find(key, key_len) >= 0) return 0;
+
+    if (!node.fits(key_len, val_len)) return -1;
+
+
+    node.insertAt(node.lowerBound(key, key_len), key, key_len, val, val_len);
+    leaf.markDirty();
+    logVarInsert(mtx, leaf.get(), key, key_len, val, val_len);
+    return 1;
+}
+
+
+bool VarBPlusTree::insert(const char* key, int key_len, const char* val, int val_len) {
+
+    if (key_len < 0 || key_len > VAR_MAX_KEY_SIZE || val_len < 0 || val_len > VAR_MAX_VALUE_SIZE) return false;
+
+    {
+        WritePath path;
+        path.nodes.push_back(findLeaf(key, key_len, LATCH_EXCLUSIVE));
+
+        int res = insertIntoLeaf(path.mtx, path.nodes.back(), key, key_len, val, val_len);
+        if (res >= 0) {
+            finish(path);
+            return res == 1;
+        }
+    }
+
+
+    WritePath path;
+    lockPath(key, key_len, val_len, path);
+
+    int res = insertIntoLeaf(path.mtx, path.nodes.back(), key, key_len, val, val_len);
+
+    if (res < 0) insertSplitLeaf(path, key, key_len, val, val_len);
+
+    finish(path);
+    return res != 0;
+
+}
+
+
+void VarBPlusTree::insertSplitLeaf(WritePath& path, const char* key, int key_len, const char* val, int val_len) {
+    PageGuard& old_leaf = path.nodes.back();
+    PageHeader* old_h = old_leaf->getHeader();
+
+    std::vector<char> copy(old_leaf->data, old_leaf->data + PAGE_SIZE);
+    VarNode src(reinterpret_cast<Page*>(copy.data()));
+
+    std::vector<SplitEntry> entries = withEntry(src, src.lowerBound(key, key_len), std::string(key, key_len), val, val_len);
+
+    int total = entries.size();
+    int sep_len;
+    int mid = chooseSplit(entries, src.prefixLen(), false, sep_len);
+    std::string up_key = entries[mid].key.substr(0, sep_len);
+
+    int left_pfx, right_pfx;
+    splitPrefixes(path, src, up_key, left_pfx, right_pfx);
+
+    PageId new_id = dm->allocatePage();
+
+    PageGuard new_leaf = dm->newPage(new_id);
+    initPage(new_leaf.get(), new_id, PAGE_LEAF, 0);
+
+    VarNode old_node(old_leaf.get());
+    VarNode new_node(new_leaf.get());
+
+    old_node.init(up_key.data(), left_pfx);
+    fillNode(old_node, entries, 0, mid);
+
+    new_node.init(up_key.data(), right_pfx);
+    fillNode(new_node, entries, mid, total);
+
+    new_leaf->getHeader()->right_link = old_h->right_link;
+
+    old_h->right_link = new_id;
+    old_leaf.markDirty();
+    path.mtx.logImage(old_leaf.get());
+    path.mtx.logImage(new_leaf.get());
+
+    PageId old_id = old_h->page_id;
+    path.mtx.hold(std::move(new_leaf));
+    path.retire();
+
+    insertIntoParent(path, old_id, up_key, new_id, 0);
+
+}
+
+
+void VarBPlusTree::splitPrefixes(WritePath& path, const VarNode& node, const std::string& sep, int& left_pfx, int& right_pfx) {
+    left_pfx = right_pfx = node.prefixLen();
+
+    if (path.nodes.size() < 2) return;
+
+    VarNode parent(path.nodes[path.nodes.size() - 2].get());
+    int idx = parent.upperBound(sep.data(), sep.size()) - 1;
+
+    if (idx >= 0) {
+        std::string low = parent.fullKey(idx);
+        left_pfx = commonPrefix(low.data(), low.size(), sep.data(), sep.size());
+    }
+    if (idx + 1 < parent.size()) {
+        std::string high = parent.fullKey(idx + 1);
+        right_pfx = commonPrefix(sep.data(), sep.size(), high.data(), high.size());
+    }
+}
+
+
+void VarBPlusTree::insertIntoParent(WritePath& path, PageId left_id, const std::string& key, PageId right_id, int level) {
+
+    if (path.nodes.empty()) {
+        PageId new_root_id = dm->allocatePage();
+
+        PageGuard root = dm->newPage(new_root_id);
+
+        initPage(root.get(), new_root_id, PAGE_INTERNAL, level + 1);
+
+        root->getHeader()->extra_ptr = left_id;
+        VarNode(root.get()).insertChild(0, key.data(), key.size(), right_id);
+
+        path.mtx.logImage(root.get());
+        path.mtx.hold(std::move(root));
+
+        updateRoot(path.mtx, new_root_id);
+
+        return;
+
+    }
+
+
+    PageGuard& parent = path.nodes.back();
+    VarNode pn(parent.get());
+
+
+    if (pn.fits(key.size(), sizeof(PageId))) {
+
+        pn.insertChild(pn.lowerBound(key.data(), key.size()), key.data(), key.size(), right_id);
+        parent.markDirty();
+        logVarInsert(path.mtx, parent.get(), key.data(), key.size(), reinterpret_cast<const char*>(&right_id), sizeof(PageId));
+    } else {
+
+        insertSplitInternal(path, key, right_id);
+    }
+
+}
+
+
+void VarBPlusTree::insertSplitInternal(WritePath& path, const std::string& key, PageId right_id) {
+    PageGuard& old_node = path.nodes.back();
+    PageHeader* old_h = old_node->getHeader();
+
+    std::vector<char> copy(old_node->data, old_node->data + PAGE_SIZE);
+    VarNode src(reinterpret_cast<Page*>(copy.data()));
+
+    std::vector<SplitEntry> entries = withEntry(src, src.lowerBound(key.data(), key.size()), key, reinterpret_cast<const char*>(&right_id), sizeof(PageId));
+
+    int total = entries.size();
+    int sep_len;
+    int mid = chooseSplit(entries, src.prefixLen(), true, sep_len);
+    std::string up_key = entries[mid].key;
+
+    int left_pfx, right_pfx;
+    splitPrefixes(path, src, up_key, left_pfx, right_pfx);
+
+
+    PageId new_id = dm->allocatePage();
+
+    PageGuard new_node = dm->newPage(new_id);
+    initPage(new_node.get(), new_id, PAGE_INTERNAL, old_h->level);
+
+    VarNode old_n(old_node.get());
+    VarNode new_n(new_node.get());
+
+    old_n.init(up_key.data(), left_pfx);
+    fillNode(old_n, entries, 0, mid);
+
+    std::memcpy(&new_node->getHeader()->extra_ptr, entries[mid].val, sizeof(PageId));
+    new_n.init(up_key.data(), right_pfx);
+    fillNode(new_n, entries, mid + 1, total);
+
+
+    old_node.markDirty();
+    path.mtx.logImage(old_node.get());
+    path.mtx.logImage(new_node.get());
+
+    PageId old_id = old_h->page_id;
+    int level = old_h->level;
+    path.mtx.hold(std::move(new_node));
+    path.retire();
+
+    insertIntoParent(path, old_id, up_key, new_id, level);
+
+}
+
+
+bool VarBPlusTree::remove(const char* key, int key_len) {
+
+    WritePath path;
+    path.nodes.push_back(findLeaf(key, key_len, LATCH_EXCLUSIVE));
+
+    PageGuard& leaf = path.nodes.back();
+    VarNode node(leaf.get());
+
+    int idx = node.find(key, key_len);
+    if (idx < 0) return false;
+
+    node.removeAt(idx);
+    leaf.markDirty();
+    logVarDelete(path.mtx, leaf.get(), key, key_len);
+
+    finish(path);
+    return true;
+}
+
+
+void VarBPlusTree::scanBatch(VarCursor& c) {
+    c.batch.clear();
+    c.pos = 0;
+
+    PageGuard leaf = findLeaf(c.low.data(), c.low.size(), LATCH_SHARED);
+
+    while (leaf && !c.exhausted && c.batch.size() < (size_t)SCAN_BATCH_ITEMS) {
+
+        VarNode node(leaf.get());
+
+        int n = node.size();
+        int i = c.low_inclusive ? node.lowerBound(c.low.data(), c.low.size()) : node.upperBound(c.low.data(), c.low.size());
+
+        for (; i < n && c.batch.size() < (size_t)SCAN_BATCH_ITEMS; i++) {
+            if (c.bounded && node.compare(i, c.high.data(), c.high.size()) > 0) { c.exhausted = true; break; }
+
+            VarEntry e;
+            e.key.assign(node.prefix(), node.prefixLen());
+            e.key.append(node.key(i), node.keyLen(i));
+            e.value.assign(node.value(i), node.valueLen(i));
+            c.batch.push_back(std::move(e));
+        }
+
+        if (c.exhausted || c.batch.size() >= (size_t)SCAN_BATCH_ITEMS) break;
+
+        PageGuard next = dm->getPage(leaf->getHeader()->right_link, LATCH_SHARED);
+        leaf = std::move(next);
+    }
+
+    if (!leaf) c.exhausted = true;
+    if (!c.batch.empty()) {
+        c.low = c.batch.back().key;
+        c.low_inclusive = false;
+    }
+}
+
+
+bool VarCursor::fill() {
+    if (exhausted || !tree) return false;
+
+    tree->scanBatch(*this);
+    return !batch.empty();
+}
+
+
+const VarEntry* VarCursor::next() {
+    if (pos == batch.size() && !fill()) return nullptr;
+
+    return &batch[pos++];
+}
+
+
+void VarBPlusTree::logVarInsert(MiniTxn& mtx, Page* p, const char* key, int key_len, const char* val, int val_len) {
+    VarEntryLog r = { (uint16_t)key_len, (uint16_t)val_len };
+    std::vector<char> buf(sizeof(r) + key_len + val_len);
+    std::memcpy(buf.data(), &r, sizeof(r));
+    std::memcpy(buf.data() + sizeof(r), key, key_len);
+    std::memcpy(buf.data() + sizeof(r) + key_len, val, val_len);
+    mtx.add(p, LOG_VAR_INSERT, buf.data(), buf.size());
+}
+
+
+void VarBPlusTree::logVarDelete(MiniTxn& mtx, Page* p, const char* key, int key_len) {
+    mtx.add(p, LOG_VAR_DELETE, key, key_len);
+}
+
+
+void VarBPlusTree::redo(Page* p, const LogEntryHeader* e, const char* data) {
+    VarNode var(p);
+
+    switch (e->type) {
+    case LOG_VAR_INSERT: {
+        VarEntryLog r;
+        std::memcpy(&r, data, sizeof(r));
+        const char* key = data + sizeof(r);
+        var.insertAt(var.lowerBound(key, r.key_len), key, r.key_len, key + r.key_len, r.val_len);
+        break;
+    }
+
+    case LOG_VAR_DELETE: {
+        int idx = var.find(data, e->len);
+        if (idx >= 0) var.removeAt(idx);
+        break;
+    }
+    }
+}
@@ -0,0 +1,89 @@
+#ifndef VAR_B_PLUS_TREE_H
+
+#define VAR_B_PLUS_TREE_H
+
+#include "BPlusTree.h"
+#include "VarNode.h"
+
+#include <string>
+#include <vector>
+
+struct VarEntryLog {
+    uint16_t key_len;
+    uint16_t val_len;
+};
+
+struct VarEntry {
+    std::string key;
+    std::string value;
+};
+
+class VarBPlusTree;
+
+class VarCursor {
+    VarBPlusTree* tree;
+    std::string low;
+    std::string high;
+    bool low_inclusive;
+    bool bounded;
+    bool exhausted;
+    std::vector<VarEntry> batch;
+    size_t pos;
+
+    friend class VarBPlusTree;
+
+    bool fill();
+public:
+    VarCursor() : tree(nullptr), low_inclusive(true), bounded(true), exhausted(true), pos(0) {}
+    VarCursor(VarBPlusTree* tree, const char* low, int low_len, const char* high, int high_len)
+        : tree(tree), low(low ? low : "", low ? low_len : 0), high(high ? high : "", high ? high_len : 0), low_inclusive(true),
+          bounded(high != nullptr), exhausted(bounded && compareKeys(this->low.data(), this->low.size(), high, high_len) > 0), pos(0) {}
+
+    const VarEntry* next();
+};
+
+class VarBPlusTree {
+    friend class VarCursor;
+
+    DiskManager* dm;
+    PageId root_page_id;
+    RWLatch root_latch;
+
+    void initPage(Page* p, PageId id, int type, int level);
+    void updateRoot(MiniTxn& mtx, PageId new_root);
+    void finish(WritePath& path);
+    PageId childOf(Page* p, const char* key, int len);
+    PageGuard findLeaf(const char* key, int len, LatchMode leaf_mode);
+
+    bool isSafe(Page* p, int key_len, int val_len);
+    void lockPath(const char* key, int key_len, int val_len, WritePath& path);
+
+    int insertIntoLeaf(MiniTxn& mtx, PageGuard& leaf, const char* key, int key_len, const char* val, int val_len);
+    void splitPrefixes(WritePath& path, const VarNode& node, const std::string& sep, int& left_pfx, int& right_pfx);
+    void insertSplitLeaf(WritePath& path, const char* key, int key_len, const char* val, int val_len);
+    void insertIntoParent(WritePath& path, PageId left_id, const std::string& key, PageId right_id, int level);
+    void insertSplitInternal(WritePath& path, const std::string& key, PageId right_id);
+
+    void scanBatch(VarCursor& c);
+
+    static void logVarInsert(MiniTxn& mtx, Page* p, const char* key, int key_len, const char* val, int val_len);
+    static void logVarDelete(MiniTxn& mtx, Page* p, const char* key, int key_len);
+    static void redo(Page* p, const LogEntryHeader* e, const char* data);
+public:
+
+    VarBPlusTree(int pool_frames = DEFAULT_POOL_FRAMES, const char* path = VAR_DB_FILE, const char* wal_path = VAR_WAL_FILE, BufferPool* shared_pool = nullptr);
+
+    ~VarBPlusTree();
+    void flush();
+
+    int find(const char* key, int key_len, char* out, int out_cap);
+    bool insert(const char* key, int key_len, const char* val, int val_len);
+
+    bool remove(const char* key, int key_len);
+
+    VarCursor scan(const char* low, int low_len, const char* high, int high_len) { return VarCursor(this, low, low_len, high, high_len); }
+
+    BufferPoolStats poolStats() { return dm->poolStats(); }
+    long long filePages() const { return dm->filePages(); }
+};
+#endif
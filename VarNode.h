@@ -0,0 +1,185 @@
+#ifndef VAR_NODE_H
+#define VAR_NODE_H
+
+#include "common.h"
+#include <string>
+
+struct SlotHeader {
+    uint16_t heap_start;
+    uint16_t garbage;
+    uint16_t prefix_len;
+    uint16_t reserved;
+};
+
+struct Slot {
+    uint16_t offset;
+    uint16_t key_len;
+    uint16_t val_len;
+};
+
+const int VAR_SLOTS_OFFSET = sizeof(PageHeader) + sizeof(SlotHeader);
+const int VAR_PAGE_SPACE = PAGE_SIZE - VAR_SLOTS_OFFSET;
+
+static_assert(PAGE_SIZE <= 65536, "slot offsets are 16-bit");
+static_assert(3 * (VAR_MAX_KEY_SIZE + VAR_MAX_VALUE_SIZE + (int)sizeof(Slot)) <= VAR_PAGE_SPACE, "a slotted page must hold three maximal entries");
+
+inline int compareKeys(const char* a, int a_len, const char* b, int b_len) {
+    int c = std::memcmp(a, b, a_len < b_len ? a_len : b_len);
+    if (c != 0) return c;
+    return a_len - b_len;
+}
+
+inline int commonPrefix(const char* a, int a_len, const char* b, int b_len) {
+    int n = a_len < b_len ? a_len : b_len;
+    int i = 0;
+    while (i < n && a[i] == b[i]) i++;
+    return i;
+}
+
+class VarNode {
+    Page* page;
+public:
+    explicit VarNode(Page* p) : page(p) {}
+
+    static int entrySize(int key_len, int val_len) { return key_len + val_len + sizeof(Slot); }
+
+    PageHeader* header() const { return page->getHeader(); }
+    SlotHeader* slotHeader() const { return reinterpret_cast<SlotHeader*>(page->data + sizeof(PageHeader)); }
+    int slotsStart() const { return VAR_SLOTS_OFFSET + ((slotHeader()->prefix_len + 1) & ~1); }
+    Slot* slots() const { return reinterpret_cast<Slot*>(page->data + slotsStart()); }
+    int size() const { return header()->num_items; }
+
+    const char* prefix() const { return page->data + VAR_SLOTS_OFFSET; }
+    int prefixLen() const { return slotHeader()->prefix_len; }
+
+    const char* key(int i) const { return page->data + slots()[i].offset; }
+    int keyLen(int i) const { return slots()[i].key_len; }
+
+    std::string fullKey(int i) const {
+        std::string k(prefix(), prefixLen());
+        k.append(key(i), keyLen(i));
+        return k;
+    }
+
+    char* value(int i) const { return page->data + slots()[i].offset + slots()[i].key_len; }
+    int valueLen(int i) const { return slots()[i].val_len; }
+    int entrySize(int i) const { return entrySize(keyLen(i), valueLen(i)); }
+
+    PageId child(int i) const {
+        PageId id;
+        std::memcpy(&id, value(i), sizeof(PageId));
+        return id;
+    }
+
+    int comparePrefix(const char* k, int len) const {
+        int p = prefixLen();
+        int c = std::memcmp(prefix(), k, p < len ? p : len);
+        if (c != 0) return c;
+        return len < p ? 1 : 0;
+    }
+
+    int compare(int i, const char* k, int len) const {
+        int c = comparePrefix(k, len);
+        if (c != 0) return c;
+        return compareKeys(key(i), keyLen(i), k + prefixLen(), len - prefixLen());
+    }
+
+    int lowerBound(const char* k, int len) const {
+        int c = comparePrefix(k, len);
+        if (c != 0) return c > 0 ? 0 : size();
+        k += prefixLen();
+        len -= prefixLen();
+
+        int lo = 0, hi = size();
+        while (lo < hi) {
+            int mid = (lo + hi) / 2;
+            if (compareKeys(key(mid), keyLen(mid), k, len) < 0) lo = mid + 1;
+            else hi = mid;
+        }
+        return lo;
+    }
+
+    int upperBound(const char* k, int len) const {
+        int c = comparePrefix(k, len);
+        if (c != 0) return c > 0 ? 0 : size();
+        k += prefixLen();
+        len -= prefixLen();
+
+        int lo = 0, hi = size();
+        while (lo < hi) {
+            int mid = (lo + hi) / 2;
+            if (compareKeys(key(mid), keyLen(mid), k, len) <= 0) lo = mid + 1;
+            else hi = mid;
+        }
+        return lo;
+    }
+
+    int find(const char* k, int len) const {
+        int i = lowerBound(k, len);
+        return i < size() && compare(i, k, len) == 0 ? i : -1;
+    }
+
+    int freeSpace() const { return slotHeader()->heap_start - slotsStart() - size() * (int)sizeof(Slot) + slotHeader()->garbage; }
+    bool fits(int key_len, int val_len) const { return entrySize(key_len - prefixLen(), val_len) <= freeSpace(); }
+
+    void init(const char* pfx = nullptr, int pfx_len = 0) {
+        header()->num_items = 0;
+        slotHeader()->heap_start = PAGE_SIZE;
+        slotHeader()->garbage = 0;
+        slotHeader()->prefix_len = pfx_len;
+        if (pfx_len > 0) std::memmove(page->data + VAR_SLOTS_OFFSET, pfx, pfx_len);
+    }
+
+    void compact() {
+        if (slotHeader()->garbage == 0) return;
+
+        char buf[PAGE_SIZE];
+        int top = PAGE_SIZE;
+        Slot* s = slots();
+
+        for (int i = 0; i < size(); i++) {
+            int len = s[i].key_len + s[i].val_len;
+            top -= len;
+            std::memcpy(buf + top, page->data + s[i].offset, len);
+            s[i].offset = top;
+        }
+        std::memcpy(page->data + top, buf + top, PAGE_SIZE - top);
+        slotHeader()->heap_start = top;
+        slotHeader()->garbage = 0;
+    }
+
+    void insertAt(int i, const char* k, int key_len, const char* val, int val_len) {
+        k += prefixLen();
+        key_len -= prefixLen();
+
+        int n = size();
+        int slots_end = slotsStart() + (n + 1) * (int)sizeof(Slot);
+        if (slotHeader()->heap_start - key_len - val_len < slots_end) compact();
+
+        int off = slotHeader()->heap_start - key_len - val_len;
+        std::memcpy(page->data + off, k, key_len);
+        std::memcpy(page->data + off + key_len, val, val_len);
+        slotHeader()->heap_start = off;
+
+        Slot* s = slots();
+        std::memmove(s + i + 1, s + i, (n - i) * sizeof(Slot));
+        s[i].offset = off;
+        s[i].key_len = key_len;
+        s[i].val_len = val_len;
+        header()->num_items = n + 1;
+    }
+
+    void insertChild(int i, const char* k, int key_len, PageId child_id) {
+        insertAt(i, k, key_len, reinterpret_cast<const char*>(&child_id), sizeof(PageId));
+    }
+
+    void removeAt(int i) {
+        int n = size();
+        Slot* s = slots();
+        slotHeader()->garbage += s[i].key_len + s[i].val_len;
+        std::memmove(s + i, s + i + 1, (n - i - 1) * sizeof(Slot));
+        header()->num_items = n - 1;
+    }
+};
+
+#endif
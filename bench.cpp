@@ -0,0 +1,482 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <random>
+#include <cmath>
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+#include <chrono>
+#include <iomanip>
+
+#include "c_api.h"
+#include "KeySearch.h"
+using namespace std;
+using namespace chrono;
+
+#define DATA_SIZE 100
+#define SCAN_ROWS 64
+
+enum OpType { OP_READ = 0, OP_WRITE = 1, OP_DELETE = 2, OP_SCAN = 3, OP_TYPES = 4 };
+static const char* OP_NAMES[OP_TYPES] = { "READ", "WRITE", "DELETE", "SCAN" };
+
+struct BenchOp {
+    int32_t type;
+    IndexKey key;
+    IndexKey key2;
+};
+
+struct Config {
+    int threads = 4;
+    long long ops = 1000000;
+    long long keys = 1000000;
+    int read_pct = 80;
+    int write_pct = 15;
+    int delete_pct = 0;
+    int scan_pct = 5;
+    int scan_len = 100;
+    bool zipf = true;
+    double theta = 0.99;
+    int pool = 0;
+    int batch = 1;
+    int interval_ms = 1000;
+    bool preload = true;
+    string save_ops;
+    string load_ops;
+};
+
+
+class Histogram {
+    static const int SUB_BITS = 4;
+    static const int BUCKETS = 64 << SUB_BITS;
+    vector<long long> counts;
+    long long total;
+    long long max_ns;
+
+    static int bucketOf(long long v) {
+        if (v < (1 << SUB_BITS)) return (int)v;
+        int msb = 63 - __builtin_clzll(v);
+        int sub = (int)((v >> (msb - SUB_BITS)) & ((1 << SUB_BITS) - 1));
+        return ((msb - SUB_BITS + 1) << SUB_BITS) + sub;
+    }
+    static long long bucketUpper(int b) {
+        if (b < (1 << SUB_BITS)) return b;
+        int msb = (b >> SUB_BITS) + SUB_BITS - 1;
+        long long sub = b & ((1 << SUB_BITS) - 1);
+        return (1LL << msb) + ((sub + 1) << (msb - SUB_BITS)) - 1;
+    }
+public:
+    Histogram() : counts(BUCKETS, 0), total(0), max_ns(0) {}
+
+    void record(long long ns) {
+        counts[bucketOf(ns)]++;
+        total++;
+        if (ns > max_ns) max_ns = ns;
+    }
+    void merge(const Histogram& o) {
+        for (int i = 0; i < BUCKETS; i++) counts[i] += o.counts[i];
+        total += o.total;
+        if (o.max_ns > max_ns) max_ns = o.max_ns;
+    }
+    long long count() const { return total; }
+    long long max() const { return max_ns; }
+    long long percentile(double p) const {
+        if (total == 0) return 0;
+        long long target = (long long)ceil(p / 100.0 * total);
+        if (target < 1) target = 1;
+        long long seen = 0;
+        for (int i = 0; i < BUCKETS; i++) {
+            seen += counts[i];
+            if (seen >= target) return min(bucketUpper(i), max_ns);
+        }
+        return max_ns;
+    }
+};
+
+
+class ZipfGenerator {
+    long long n;
+    double theta, alpha, zetan, eta;
+
+    static double zeta(long long n, double theta) {
+        double sum = 0;
+        for (long long i = 1; i <= n; i++) sum += 1.0 / pow((double)i, theta);
+        return sum;
+    }
+public:
+    ZipfGenerator(long long n, double theta) : n(n), theta(theta) {
+        zetan = zeta(n, theta);
+        double zeta2 = zeta(2, theta);
+        alpha = 1.0 / (1.0 - theta);
+        eta = (1 - pow(2.0 / n, 1 - theta)) / (1 - zeta2 / zetan);
+    }
+    long long next(double u) const {
+        double uz = u * zetan;
+        if (uz < 1.0) return 0;
+        if (uz < 1.0 + pow(0.5, theta)) return 1;
+        long long v = (long long)(n * pow(eta * u - eta + 1, alpha));
+        return v >= n ? n - 1 : v;
+    }
+};
+
+
+static IndexKey scrambleKey(long long rank, long long keys) {
+    uint64_t h = 14695981039346656037ULL;
+    for (int i = 0; i < 8; i++) {
+        h ^= (rank >> (i * 8)) & 0xff;
+        h *= 1099511628211ULL;
+    }
+    return (IndexKey)(h % (uint64_t)keys);
+}
+
+
+static vector<vector<BenchOp> > generateOps(const Config& cfg) {
+    vector<vector<BenchOp> > streams(cfg.threads);
+    ZipfGenerator* zipf = cfg.zipf ? new ZipfGenerator(cfg.keys, cfg.theta) : nullptr;
+    long long per_thread = cfg.ops / cfg.threads;
+
+    for (int t = 0; t < cfg.threads; t++) {
+        mt19937_64 rng(12345 + t);
+        uniform_real_distribution<double> unit(0.0, 1.0);
+        streams[t].resize(per_thread);
+
+        for (long long i = 0; i < per_thread; i++) {
+            BenchOp& op = streams[t][i];
+            int r = (int)(rng() % 100);
+
+            if (r < cfg.read_pct) op.type = OP_READ;
+            else if (r < cfg.read_pct + cfg.write_pct) op.type = OP_WRITE;
+            else if (r < cfg.read_pct + cfg.write_pct + cfg.delete_pct) op.type = OP_DELETE;
+            else op.type = OP_SCAN;
+
+            op.key = zipf ? scrambleKey(zipf->next(unit(rng)), cfg.keys) : (IndexKey)(rng() % (uint64_t)cfg.keys);
+            op.key2 = op.type == OP_SCAN ? op.key + cfg.scan_len - 1 : 0;
+        }
+    }
+
+    delete zipf;
+    return streams;
+}
+
+
+static bool saveOps(const string& path, const vector<vector<BenchOp> >& streams) {
+    ofstream out(path.c_str(), ios::binary);
+    if (!out) return false;
+
+    int32_t threads = streams.size();
+    out.write((const char*)&threads, sizeof(threads));
+    for (size_t t = 0; t < streams.size(); t++) {
+        int64_t n = streams[t].size();
+        out.write((const char*)&n, sizeof(n));
+        out.write((const char*)streams[t].data(), n * sizeof(BenchOp));
+    }
+    return (bool)out;
+}
+
+
+static bool loadOps(const string& path, vector<vector<BenchOp> >& streams) {
+    ifstream in(path.c_str(), ios::binary);
+    if (!in) return false;
+
+    int32_t threads = 0;
+    in.read((char*)&threads, sizeof(threads));
+    if (!in || threads <= 0) return false;
+
+    streams.assign(threads, vector<BenchOp>());
+    for (int t = 0; t < threads; t++) {
+        int64_t n = 0;
+        in.read((char*)&n, sizeof(n));
+        if (!in || n < 0) return false;
+        streams[t].resize(n);
+        in.read((char*)streams[t].data(), n * sizeof(BenchOp));
+    }
+    return (bool)in;
+}
+
+
+// With --batch, reads and writes are timed once per multiGet / multiPut call into
+// batch[] rather than spread over their keys, so hist[] only holds single operations.
+struct ThreadResult {
+    Histogram hist[OP_TYPES];
+    Histogram batch[OP_TYPES];
+    long long batch_keys[OP_TYPES];
+    long long found;
+    long long scanned;
+    ThreadResult() : batch_keys(), found(0), scanned(0) {}
+};
+
+static atomic<long long> completed(0);
+static atomic<bool> running(false);
+
+
+static void runStream(const vector<BenchOp>& ops, int batch, ThreadResult& res) {
+    unsigned char data[DATA_SIZE];
+    memset(data, 'B', DATA_SIZE);
+    unsigned char out[DATA_SIZE];
+    IndexKey keys[SCAN_ROWS];
+    vector<unsigned char> scan_buf(SCAN_ROWS * DATA_SIZE);
+    unsigned char* rows = scan_buf.data();
+    vector<IndexKey> batch_keys(batch);
+    vector<unsigned char> batch_rows((size_t)batch * DATA_SIZE, 'B');
+    long long pending = 0;
+
+    while (!running.load()) this_thread::yield();
+
+    for (size_t i = 0; i < ops.size(); ) {
+        const BenchOp& op = ops[i];
+        size_t n = 1;
+        bool batched = batch > 1 && (op.type == OP_READ || op.type == OP_WRITE);
+        auto start = steady_clock::now();
+
+        if (batched) {
+            while (i + n < ops.size() && n < (size_t)batch && ops[i + n].type == op.type) n++;
+
+            for (size_t j = 0; j < n; j++) {
+                batch_keys[j] = ops[i + j].key;
+                if (op.type == OP_WRITE) memcpy(&batch_rows[j * DATA_SIZE], &ops[i + j].key, sizeof(op.key));
+            }
+            if (op.type == OP_READ) res.found += multiGet(batch_keys.data(), n, batch_rows.data(), nullptr);
+            else multiPut(batch_keys.data(), batch_rows.data(), n);
+        } else if (op.type == OP_READ) {
+            if (readDataInto(op.key, out)) res.found++;
+        } else if (op.type == OP_WRITE) {
+            memcpy(data, &op.key, sizeof(op.key));
+            writeData(op.key, data);
+        } else if (op.type == OP_DELETE) {
+            deleteData(op.key);
+        } else {
+            ScanCursor* c = openScan(op.key, op.key2, 0);
+            int n;
+            while ((n = scanNextBatch(c, keys, rows, SCAN_ROWS)) > 0) res.scanned += n;
+            closeScan(c);
+        }
+
+        auto end = steady_clock::now();
+        long long ns = duration_cast<nanoseconds>(end - start).count();
+        if (batched) {
+            res.batch[op.type].record(ns);
+            res.batch_keys[op.type] += n;
+        } else {
+            res.hist[op.type].record(ns);
+        }
+
+        i += n;
+        pending += n;
+        if (pending >= 64) {
+            completed.fetch_add(pending, memory_order_relaxed);
+            pending = 0;
+        }
+    }
+    completed.fetch_add(pending, memory_order_relaxed);
+}
+
+
+struct PreloadSource {
+    IndexKey next;
+    long long keys;
+};
+
+static int nextPreload(void* ctx, IndexKey* key, unsigned char* data) {
+    PreloadSource* src = static_cast<PreloadSource*>(ctx);
+    if (src->next >= src->keys) return 0;
+    *key = src->next++;
+    memset(data, 'P', DATA_SIZE);
+    return 1;
+}
+
+
+static void usage(const char* prog) {
+    cerr << "usage: " << prog << " [options]" << endl
+         << "  --threads N      worker threads (default 4)" << endl
+         << "  --ops N          total operations (default 1000000)" << endl
+         << "  --keys N         key space size (default 1000000)" << endl
+         << "  --read P --write P --delete P --scan P   operation mix in percent" << endl
+         << "  --scan-len N     keys per range scan (default 100)" << endl
+         << "  --dist zipf|uniform [--theta T]           key distribution" << endl
+         << "  --pool N         buffer pool frames" << endl
+         << "  --batch N        issue runs of reads / writes as multiGet / multiPut of up to N keys" << endl
+         << "  --interval MS    throughput report interval (default 1000)" << endl
+         << "  --no-preload     do not load the key space before the run" << endl
+         << "  --save-ops FILE  write the generated op streams to FILE" << endl
+         << "  --load-ops FILE  replay op streams from FILE instead of generating" << endl;
+}
+
+
+static bool parseArgs(int argc, char* argv[], Config& cfg) {
+    for (int i = 1; i < argc; i++) {
+        string a = argv[i];
+        bool has_val = i + 1 < argc;
+
+        if (a == "--no-preload") { cfg.preload = false; continue; }
+        if (!has_val) return false;
+
+        string v = argv[++i];
+        if (a == "--threads") cfg.threads = atoi(v.c_str());
+        else if (a == "--ops") cfg.ops = atoll(v.c_str());
+        else if (a == "--keys") cfg.keys = atoll(v.c_str());
+        else if (a == "--read") cfg.read_pct = atoi(v.c_str());
+        else if (a == "--write") cfg.write_pct = atoi(v.c_str());
+        else if (a == "--delete") cfg.delete_pct = atoi(v.c_str());
+        else if (a == "--scan") cfg.scan_pct = atoi(v.c_str());
+        else if (a == "--scan-len") cfg.scan_len = atoi(v.c_str());
+        else if (a == "--dist") cfg.zipf = v == "zipf";
+        else if (a == "--theta") cfg.theta = atof(v.c_str());
+        else if (a == "--pool") cfg.pool = atoi(v.c_str());
+        else if (a == "--batch") cfg.batch = atoi(v.c_str());
+        else if (a == "--interval") cfg.interval_ms = atoi(v.c_str());
+        else if (a == "--save-ops") cfg.save_ops = v;
+        else if (a == "--load-ops") cfg.load_ops = v;
+        else return false;
+    }
+
+    if (cfg.threads < 1 || cfg.keys < 1 || cfg.ops < 1 || cfg.batch < 1) return false;
+    return cfg.read_pct + cfg.write_pct + cfg.delete_pct + cfg.scan_pct == 100;
+}
+
+
+static void printHistogram(const char* name, const Histogram& h, long long units, double seconds) {
+    cout << "  " << left << setw(8) << name << right
+         << setw(12) << h.count()
+         << setw(14) << fixed << setprecision(0) << (seconds > 0 ? units / seconds : 0.0)
+         << setw(10) << setprecision(2) << h.percentile(50) / 1000.0
+         << setw(10) << h.percentile(99) / 1000.0
+         << setw(10) << h.percentile(99.9) / 1000.0
+         << setw(12) << h.max() / 1000.0 << endl;
+}
+
+
+int main(int argc, char* argv[]) {
+    Config cfg;
+    if (!parseArgs(argc, argv, cfg)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    vector<vector<BenchOp> > streams;
+    if (!cfg.load_ops.empty()) {
+        if (!loadOps(cfg.load_ops, streams)) {
+            cerr << "ERROR: Could not read op stream file: " << cfg.load_ops << endl;
+            return 1;
+        }
+        cfg.threads = streams.size();
+    } else {
+        streams = generateOps(cfg);
+    }
+
+    if (!cfg.save_ops.empty() && !saveOps(cfg.save_ops, streams)) {
+        cerr << "ERROR: Could not write op stream file: " << cfg.save_ops << endl;
+        return 1;
+    }
+
+    long long total_ops = 0;
+    for (size_t t = 0; t < streams.size(); t++) total_ops += streams[t].size();
+
+    cout << "========================================" << endl;
+    cout << "B+ Tree Benchmark" << endl;
+    cout << "========================================" << endl;
+    cout << "Threads:      " << cfg.threads << endl;
+    cout << "Operations:   " << total_ops << endl;
+    cout << "Key space:    " << cfg.keys << (cfg.zipf ? " (zipfian)" : " (uniform)") << endl;
+    if (cfg.load_ops.empty()) {
+        cout << "Mix:          read " << cfg.read_pct << "% / write " << cfg.write_pct
+             << "% / delete " << cfg.delete_pct << "% / scan " << cfg.scan_pct << "%" << endl;
+    }
+    if (cfg.batch > 1) cout << "Batch:        " << cfg.batch << " keys, " << MULTI_LOOKUP_LANES << " lookup lanes" << endl;
+    cout << "Key search:   " << keySearchKernel() << endl;
+    cout << endl;
+
+    if (cfg.pool > 0) initWithPoolSize(cfg.pool);
+    else init();
+
+    if (cfg.preload) {
+        unsigned char data[DATA_SIZE];
+        memset(data, 'P', DATA_SIZE);
+        auto start = steady_clock::now();
+        PreloadSource src = { 0, cfg.keys };
+        if (bulkLoadData(nextPreload, &src, 1.0) < 0) {
+            for (long long k = 0; k < cfg.keys; k++) writeData((IndexKey)k, data);
+        }
+        duration<double> took = steady_clock::now() - start;
+        cout << "Preloaded " << cfg.keys << " keys in " << fixed << setprecision(3) << took.count() << " seconds" << endl << endl;
+    }
+
+    vector<ThreadResult> results(cfg.threads);
+    vector<thread> workers;
+    for (int t = 0; t < cfg.threads; t++) workers.push_back(thread(runStream, cref(streams[t]), cfg.batch, ref(results[t])));
+
+    cout << "THROUGHPUT:" << endl;
+    auto start = steady_clock::now();
+    running.store(true);
+
+    long long last = 0;
+    auto last_time = start;
+    while (completed.load() < total_ops) {
+        auto next = last_time + milliseconds(cfg.interval_ms);
+        while (completed.load() < total_ops && steady_clock::now() < next) this_thread::sleep_for(milliseconds(5));
+        auto now = steady_clock::now();
+        long long done = completed.load();
+        duration<double> elapsed = now - start;
+        duration<double> window = now - last_time;
+        cout << "  t=" << fixed << setprecision(1) << setw(6) << elapsed.count() << "s  "
+             << setw(12) << setprecision(0) << (done - last) / window.count() << " ops/sec" << endl;
+        last = done;
+        last_time = now;
+    }
+
+    for (size_t t = 0; t < workers.size(); t++) workers[t].join();
+    duration<double> total = steady_clock::now() - start;
+
+    Histogram all;
+    Histogram per_type[OP_TYPES];
+    Histogram per_batch[OP_TYPES];
+    long long batch_keys[OP_TYPES] = {};
+    long long found = 0, scanned = 0;
+    for (size_t t = 0; t < results.size(); t++) {
+        for (int i = 0; i < OP_TYPES; i++) {
+            per_type[i].merge(results[t].hist[i]);
+            all.merge(results[t].hist[i]);
+            per_batch[i].merge(results[t].batch[i]);
+            batch_keys[i] += results[t].batch_keys[i];
+        }
+        found += results[t].found;
+        scanned += results[t].scanned;
+    }
+
+    cout << endl;
+    cout << "LATENCY (microseconds):" << endl;
+    cout << "  " << left << setw(8) << "OP" << right << setw(12) << "COUNT" << setw(14) << "OPS/SEC"
+         << setw(10) << "P50" << setw(10) << "P99" << setw(10) << "P999" << setw(12) << "MAX" << endl;
+    for (int i = 0; i < OP_TYPES; i++) {
+        if (per_type[i].count() > 0) printHistogram(OP_NAMES[i], per_type[i], per_type[i].count(), total.count());
+    }
+    if (all.count() > 0) printHistogram("ALL", all, all.count(), total.count());
+    cout << endl;
+
+    if (cfg.batch > 1) {
+        cout << "BATCH LATENCY (microseconds per multiGet / multiPut call):" << endl;
+        cout << "  " << left << setw(8) << "OP" << right << setw(12) << "BATCHES" << setw(14) << "KEYS/SEC"
+             << setw(10) << "P50" << setw(10) << "P99" << setw(10) << "P999" << setw(12) << "MAX" << endl;
+        for (int i = 0; i < OP_TYPES; i++) {
+            if (per_batch[i].count() > 0) printHistogram(OP_NAMES[i], per_batch[i], batch_keys[i], total.count());
+        }
+        cout << endl;
+    }
+
+    cout << "Total Time:   " << fixed << setprecision(3) << total.count() << " seconds" << endl;
+    cout << "Throughput:   " << setprecision(0) << total_ops / total.count() << " ops/sec" << endl;
+    cout << "Reads found:  " << found << endl;
+    cout << "Rows scanned: " << scanned << endl;
+
+    IndexStats istats;
+    getIndexStats(&istats);
+    long long lookups = istats.pool_hits + istats.pool_misses;
+    cout << "Pool hit rate:" << setprecision(2) << setw(7)
+         << (lookups > 0 ? 100.0 * istats.pool_hits / lookups : 0.0) << " %" << endl;
+    cout << "========================================" << endl;
+
+    closeIndex();
+    return 0;
+}
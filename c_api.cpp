@@ -1,46 +1,357 @@
 #include "c_api.h"
 #include "BPlusTree.h"
+#include "VarBPlusTree.h"
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <type_traits>
 
 
-BPlusTree* tree = nullptr;
+struct IndexPool {
+    BufferPool pool;
+
+    IndexPool(int frames) : pool(frames, PAGE_SIZE) {}
+};
+
+
+struct IndexHandle {
+    BPlusTree tree;
+
+    IndexHandle(int frames, const char* path, const char* wal_path, BufferPool* pool)
+        : tree(frames, path, wal_path, pool) {}
+};
+
+
+struct VarIndexHandle {
+    VarBPlusTree tree;
+
+    VarIndexHandle(int frames, const char* path, const char* wal_path, BufferPool* pool)
+        : tree(frames, path, wal_path, pool) {}
+};
+
+
+static std::atomic<IndexHandle*> tree(nullptr);
+static std::mutex tree_mutex;
+static std::atomic<VarIndexHandle*> var_tree(nullptr);
+
+
+static IndexHandle* openTree(int pool_frames) {
+    IndexHandle* t = tree.load(std::memory_order_acquire);
+    if (t) return t;
+
+    std::lock_guard<std::mutex> lk(tree_mutex);
+    t = tree.load(std::memory_order_relaxed);
+    if (!t) {
+        t = new IndexHandle(pool_frames, DB_FILE, WAL_FILE, nullptr);
+        tree.store(t, std::memory_order_release);
+    }
+    return t;
+}
+
+
+// "data/orders.bin" logs to "data/orders.wal", matching index.bin / index.wal.
+static std::string walPathFor(const char* path) {
+    std::string wal(path);
+    size_t slash = wal.find_last_of('/');
+    size_t dot = wal.find_last_of('.');
+
+    if (dot != std::string::npos && (slash == std::string::npos || dot > slash)) wal.erase(dot);
+    return wal + ".wal";
+}
+
+
+static VarIndexHandle* openVarTree() {
+    VarIndexHandle* t = var_tree.load(std::memory_order_acquire);
+    if (t) return t;
+
+    std::lock_guard<std::mutex> lk(tree_mutex);
+    t = var_tree.load(std::memory_order_relaxed);
+    if (!t) {
+        t = new VarIndexHandle(DEFAULT_POOL_FRAMES, VAR_DB_FILE, VAR_WAL_FILE, nullptr);
+        var_tree.store(t, std::memory_order_release);
+    }
+    return t;
+}
+
+
+static_assert(std::is_same<IndexKey, KeyType>::value, "IndexKey must match KeyType");
+static_assert(sizeof(TupleView) <= sizeof(ReadView) && alignof(TupleView) <= alignof(ReadView), "ReadView too small");
+
+static TupleView* viewOf(ReadView* view) {
+    return reinterpret_cast<TupleView*>(view->reserved);
+}
+
+
+struct ScanCursor {
+    RangeCursor cursor;
+};
+
+
+struct VarScanCursor {
+    VarCursor cursor;
+};
+
+
+struct BulkCallback {
+    int (*next)(void* ctx, IndexKey* key, unsigned char* data);
+    void* ctx;
+};
+
+static int bulkNext(void* ctx, KeyType* key, char* val) {
+    BulkCallback* cb = static_cast<BulkCallback*>(ctx);
+    return cb->next(cb->ctx, key, (unsigned char*)val);
+}
 
 
 extern "C" {
     void init() { 
-        if (!tree) tree = new BPlusTree(); 
+        openTree(DEFAULT_POOL_FRAMES);
+    }
+
+    void initWithPoolSize(int poolFrames) {
+        openTree(poolFrames);
     }
 
     
-    int writeData(int key, unsigned char* data) {
+    int writeData(IndexKey key, unsigned char* data) {
+
+        return indexWrite(openTree(DEFAULT_POOL_FRAMES), key, data);
+
+    }
+
+    unsigned char* readData(IndexKey key) {
+        return indexRead(openTree(DEFAULT_POOL_FRAMES), key);
+    }
+
+    int readDataInto(IndexKey key, unsigned char* out) {
+        return indexReadInto(openTree(DEFAULT_POOL_FRAMES), key, out);
+    }
+
+    const unsigned char* readDataView(IndexKey key, ReadView* view) {
+        return indexReadView(openTree(DEFAULT_POOL_FRAMES), key, view);
+    }
+
+    void releaseReadView(ReadView* view) {
+        viewOf(view)->release();
+    }
+
+    int deleteData(IndexKey key) {
+        return indexDelete(openTree(DEFAULT_POOL_FRAMES), key);
+    }
 
-        init();
-        return tree->insert(key, (const char*)data) ? 1 : 0;
+    int multiGet(const IndexKey* keys, int n, unsigned char* data, int* found) {
+        return indexMultiGet(openTree(DEFAULT_POOL_FRAMES), keys, n, data, found);
+    }
+
+    int multiPut(const IndexKey* keys, const unsigned char* data, int n) {
+        return indexMultiPut(openTree(DEFAULT_POOL_FRAMES), keys, data, n);
+    }
+
+    unsigned char** readRangeData(IndexKey lowerKey, IndexKey upperKey, int* n) {
+
+        return indexReadRange(openTree(DEFAULT_POOL_FRAMES), lowerKey, upperKey, n);
+    }
+
+    ScanCursor* openScan(IndexKey lowerKey, IndexKey upperKey, int reverse) {
+        return indexOpenScan(openTree(DEFAULT_POOL_FRAMES), lowerKey, upperKey, reverse);
+    }
 
+    int scanNext(ScanCursor* cursor, IndexKey* key, unsigned char* data) {
+        KeyType k;
+        if (!cursor->cursor.next(k, (char*)data)) return 0;
+        if (key) *key = k;
+        return 1;
     }
 
-    unsigned char* readData(int key) {
-        init();
-        return (unsigned char*)tree->find(key);
+    int scanNextBatch(ScanCursor* cursor, IndexKey* keys, unsigned char* data, int max) {
+        return cursor->cursor.nextBatch(keys, (char*)data, max);
     }
 
-    int deleteData(int key) {
-        init();
-        return tree->remove(key) ? 1 : 0;
+    void closeScan(ScanCursor* cursor) {
+        delete cursor;
     }
 
-    unsigned char** readRangeData(int lowerKey, int upperKey, int* n) {
+    long long bulkLoadData(int (*next)(void* ctx, IndexKey* key, unsigned char* data), void* ctx, double fillFactor) {
+        return indexBulkLoad(openTree(DEFAULT_POOL_FRAMES), next, ctx, fillFactor);
+    }
+
+    int writeVarData(const unsigned char* key, int keyLen, const unsigned char* data, int dataLen) {
+        return varIndexWrite(openVarTree(), key, keyLen, data, dataLen);
+    }
+
+    int readVarData(const unsigned char* key, int keyLen, unsigned char* out, int outCap) {
+        return varIndexRead(openVarTree(), key, keyLen, out, outCap);
+    }
+
+    int deleteVarData(const unsigned char* key, int keyLen) {
+        return varIndexDelete(openVarTree(), key, keyLen);
+    }
 
-        init();
-        return (unsigned char**)tree->range(lowerKey, upperKey, *n);
+    VarScanCursor* openVarScan(const unsigned char* lowerKey, int lowerLen, const unsigned char* upperKey, int upperLen) {
+        return varIndexOpenScan(openVarTree(), lowerKey, lowerLen, upperKey, upperLen);
+    }
+
+    int varScanNext(VarScanCursor* cursor, const unsigned char** key, int* keyLen, const unsigned char** data, int* dataLen) {
+        const VarEntry* e = cursor->cursor.next();
+        if (!e) return 0;
+
+        if (key) *key = (const unsigned char*)e->key.data();
+        if (keyLen) *keyLen = e->key.size();
+        if (data) *data = (const unsigned char*)e->value.data();
+        if (dataLen) *dataLen = e->value.size();
+        return 1;
+    }
+
+    void closeVarScan(VarScanCursor* cursor) {
+        delete cursor;
+    }
+
+    void getIndexStats(IndexStats* stats) {
+        indexGetStats(openTree(DEFAULT_POOL_FRAMES), stats);
     }
 
     void closeIndex() {
-        if (tree) { 
-            tree->flush(); 
-            delete tree; 
+        std::lock_guard<std::mutex> lk(tree_mutex);
+        indexClose(tree.exchange(nullptr));
+        varIndexClose(var_tree.exchange(nullptr));
+    }
+
+    void initIndexOptions(IndexOptions* options) {
+        options->poolFrames = DEFAULT_POOL_FRAMES;
+        options->pool = nullptr;
+        options->walPath = nullptr;
+    }
+
+    IndexPool* createIndexPool(int poolFrames) {
+        if (poolFrames < MIN_POOL_FRAMES) poolFrames = MIN_POOL_FRAMES;
+        return new IndexPool(poolFrames);
+    }
+
+    // Every index opened on the pool must be closed first.
+    void destroyIndexPool(IndexPool* pool) {
+        delete pool;
+    }
+
+    IndexHandle* openIndex(const char* path, const IndexOptions* options) {
+        IndexOptions defaults;
+        initIndexOptions(&defaults);
+        if (!options) options = &defaults;
 
-            tree = nullptr; 
+        std::string wal = options->walPath ? std::string(options->walPath) : walPathFor(path);
+        BufferPool* pool = options->pool ? &options->pool->pool : nullptr;
+
+        return new IndexHandle(options->poolFrames, path, wal.c_str(), pool);
+    }
+
+    int indexWrite(IndexHandle* index, IndexKey key, const unsigned char* data) {
+        return index->tree.insert(key, (const char*)data) ? 1 : 0;
+    }
+
+    unsigned char* indexRead(IndexHandle* index, IndexKey key) {
+        return (unsigned char*)index->tree.find(key);
+    }
+
+    int indexReadInto(IndexHandle* index, IndexKey key, unsigned char* out) {
+        return index->tree.findInto(key, (char*)out) ? 1 : 0;
+    }
+
+    const unsigned char* indexReadView(IndexHandle* index, IndexKey key, ReadView* view) {
+        TupleView* v = new (view->reserved) TupleView(index->tree.view(key));
+        return (const unsigned char*)v->data();
+    }
+
+    int indexDelete(IndexHandle* index, IndexKey key) {
+        return index->tree.remove(key) ? 1 : 0;
+    }
+
+    int indexMultiGet(IndexHandle* index, const IndexKey* keys, int n, unsigned char* data, int* found) {
+        if (n <= 0) return 0;
+
+        std::unique_ptr<bool[]> hit(new bool[n]);
+        int hits = index->tree.multiGet(keys, n, (char*)data, hit.get());
+        if (found) {
+            for (int i = 0; i < n; i++) found[i] = hit[i];
         }
+        return hits;
+    }
+
+    int indexMultiPut(IndexHandle* index, const IndexKey* keys, const unsigned char* data, int n) {
+        if (n <= 0) return 0;
+
+        return index->tree.multiPut(keys, (const char*)data, n);
+    }
+
+    unsigned char** indexReadRange(IndexHandle* index, IndexKey lowerKey, IndexKey upperKey, int* n) {
+        return (unsigned char**)index->tree.range(lowerKey, upperKey, *n);
+    }
+
+    ScanCursor* indexOpenScan(IndexHandle* index, IndexKey lowerKey, IndexKey upperKey, int reverse) {
+        ScanCursor* c = new ScanCursor;
+        c->cursor = index->tree.scan(lowerKey, upperKey, reverse != 0);
+        return c;
+    }
+
+    long long indexBulkLoad(IndexHandle* index, int (*next)(void* ctx, IndexKey* key, unsigned char* data), void* ctx, double fillFactor) {
+        BulkCallback cb = { next, ctx };
+        return index->tree.bulkLoad(bulkNext, &cb, fillFactor);
+    }
+
+    void indexGetStats(IndexHandle* index, IndexStats* stats) {
+        BufferPoolStats ps = index->tree.poolStats();
+        stats->pool_hits = ps.hits;
+        stats->pool_misses = ps.misses;
+        stats->pool_evictions = ps.evictions;
+        stats->pool_writebacks = ps.writebacks;
+        stats->file_pages = index->tree.filePages();
+        stats->free_pages = index->tree.freePages();
+    }
+
+    void indexClose(IndexHandle* index) {
+        if (!index) return;
+
+        index->tree.flush();
+        delete index;
+    }
+
+    VarIndexHandle* openVarIndex(const char* path, const IndexOptions* options) {
+        IndexOptions defaults;
+        initIndexOptions(&defaults);
+        if (!options) options = &defaults;
+
+        std::string wal = options->walPath ? std::string(options->walPath) : walPathFor(path);
+        BufferPool* pool = options->pool ? &options->pool->pool : nullptr;
+
+        return new VarIndexHandle(options->poolFrames, path, wal.c_str(), pool);
+    }
+
+    int varIndexWrite(VarIndexHandle* index, const unsigned char* key, int keyLen, const unsigned char* data, int dataLen) {
+        if (keyLen < 0 || keyLen > VAR_MAX_KEY_SIZE || dataLen < 0 || dataLen > VAR_MAX_VALUE_SIZE) return -1;
+
+        return index->tree.insert((const char*)key, keyLen, (const char*)data, dataLen) ? 1 : 0;
+    }
+
+    int varIndexRead(VarIndexHandle* index, const unsigned char* key, int keyLen, unsigned char* out, int outCap) {
+        return index->tree.find((const char*)key, keyLen, (char*)out, outCap);
+    }
+
+    int varIndexDelete(VarIndexHandle* index, const unsigned char* key, int keyLen) {
+        return index->tree.remove((const char*)key, keyLen) ? 1 : 0;
+    }
+
+    VarScanCursor* varIndexOpenScan(VarIndexHandle* index, const unsigned char* lowerKey, int lowerLen, const unsigned char* upperKey, int upperLen) {
+        VarScanCursor* c = new VarScanCursor;
+        c->cursor = index->tree.scan((const char*)lowerKey, lowerLen, (const char*)upperKey, upperLen);
+        return c;
+    }
+
+    void varIndexClose(VarIndexHandle* index) {
+        if (!index) return;
+
+        index->tree.flush();
+        delete index;
     }
 
-}
\ No newline at end of file
+}
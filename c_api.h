@@ -5,14 +5,90 @@
 extern "C" {
 #endif
 
+#if defined(BPT_KEY_BITS) && BPT_KEY_BITS == 64
+    typedef long long IndexKey;
+#else
+    typedef int IndexKey;
+#endif
+
+    typedef struct {
+        long long pool_hits;
+        long long pool_misses;
+        long long pool_evictions;
+        long long pool_writebacks;
+        long long file_pages;
+        long long free_pages;
+    } IndexStats;
+
+    typedef struct {
+        void* reserved[6];
+    } ReadView;
+
+    typedef struct ScanCursor ScanCursor;
+    typedef struct VarScanCursor VarScanCursor;
+    typedef struct IndexHandle IndexHandle;
+    typedef struct VarIndexHandle VarIndexHandle;
+    typedef struct IndexPool IndexPool;
+
+    typedef struct {
+        int poolFrames;
+        IndexPool* pool;
+        const char* walPath;
+    } IndexOptions;
+
     void init();
-    int writeData(int key, unsigned char* data);
-    unsigned char* readData(int key);
+    void initWithPoolSize(int poolFrames);
+    int writeData(IndexKey key, unsigned char* data);
+    unsigned char* readData(IndexKey key);
+    int readDataInto(IndexKey key, unsigned char* out);
+    const unsigned char* readDataView(IndexKey key, ReadView* view);
+    void releaseReadView(ReadView* view);
+
+    int deleteData(IndexKey key);
+    int multiGet(const IndexKey* keys, int n, unsigned char* data, int* found);
+    int multiPut(const IndexKey* keys, const unsigned char* data, int n);
+    unsigned char** readRangeData(IndexKey lowerKey, IndexKey upperKey, int* n);
+    ScanCursor* openScan(IndexKey lowerKey, IndexKey upperKey, int reverse);
+    int scanNext(ScanCursor* cursor, IndexKey* key, unsigned char* data);
+    int scanNextBatch(ScanCursor* cursor, IndexKey* keys, unsigned char* data, int max);
+    void closeScan(ScanCursor* cursor);
+    long long bulkLoadData(int (*next)(void* ctx, IndexKey* key, unsigned char* data), void* ctx, double fillFactor);
+    int writeVarData(const unsigned char* key, int keyLen, const unsigned char* data, int dataLen);
+    int readVarData(const unsigned char* key, int keyLen, unsigned char* out, int outCap);
+    int deleteVarData(const unsigned char* key, int keyLen);
+    VarScanCursor* openVarScan(const unsigned char* lowerKey, int lowerLen, const unsigned char* upperKey, int upperLen);
+    int varScanNext(VarScanCursor* cursor, const unsigned char** key, int* keyLen, const unsigned char** data, int* dataLen);
+    void closeVarScan(VarScanCursor* cursor);
 
-    int deleteData(int key);
-    unsigned char** readRangeData(int lowerKey, int upperKey, int* n);
+    void getIndexStats(IndexStats* stats);
     void closeIndex();
 
+    void initIndexOptions(IndexOptions* options);
+    // Pools hold PAGE_SIZE (4 KB) frames, the page size of every index the C API opens.
+    // Other tree shapes, such as the 16 KB LargePageBPlusTree, need a C++ BufferPool sized for them.
+    IndexPool* createIndexPool(int poolFrames);
+    void destroyIndexPool(IndexPool* pool);
+    IndexHandle* openIndex(const char* path, const IndexOptions* options);
+    int indexWrite(IndexHandle* index, IndexKey key, const unsigned char* data);
+    unsigned char* indexRead(IndexHandle* index, IndexKey key);
+    int indexReadInto(IndexHandle* index, IndexKey key, unsigned char* out);
+    const unsigned char* indexReadView(IndexHandle* index, IndexKey key, ReadView* view);
+    int indexDelete(IndexHandle* index, IndexKey key);
+    int indexMultiGet(IndexHandle* index, const IndexKey* keys, int n, unsigned char* data, int* found);
+    int indexMultiPut(IndexHandle* index, const IndexKey* keys, const unsigned char* data, int n);
+    unsigned char** indexReadRange(IndexHandle* index, IndexKey lowerKey, IndexKey upperKey, int* n);
+    ScanCursor* indexOpenScan(IndexHandle* index, IndexKey lowerKey, IndexKey upperKey, int reverse);
+    long long indexBulkLoad(IndexHandle* index, int (*next)(void* ctx, IndexKey* key, unsigned char* data), void* ctx, double fillFactor);
+    void indexGetStats(IndexHandle* index, IndexStats* stats);
+    void indexClose(IndexHandle* index);
+
+    VarIndexHandle* openVarIndex(const char* path, const IndexOptions* options);
+    int varIndexWrite(VarIndexHandle* index, const unsigned char* key, int keyLen, const unsigned char* data, int dataLen);
+    int varIndexRead(VarIndexHandle* index, const unsigned char* key, int keyLen, unsigned char* out, int outCap);
+    int varIndexDelete(VarIndexHandle* index, const unsigned char* key, int keyLen);
+    VarScanCursor* varIndexOpenScan(VarIndexHandle* index, const unsigned char* lowerKey, int lowerLen, const unsigned char* upperKey, int upperLen);
+    void varIndexClose(VarIndexHandle* index);
+
 #ifdef __cplusplus
 }
 #endif
@@ -3,53 +3,108 @@
 #define COMMON_H
 #include <cstring>
 #include <cstdint>
+#include <limits>
 
 extern const char* DB_FILE;
+extern const char* WAL_FILE;
+extern const char* VAR_DB_FILE;
+extern const char* VAR_WAL_FILE;
 const int PAGE_SIZE = 4096;
+const int MAX_PAGE_SIZE = 65536;
 const int TUPLE_SIZE = 100;
 
-const int INVALID_PAGE_ID = -1;
-
-const long long MAX_DB_SIZE = 256L * 1024 * 1024; 
-enum PageType { PAGE_INVALID = 0, PAGE_INTERNAL = 1, PAGE_LEAF = 2, PAGE_META = 3 };
-struct PageHeader {
-    int page_id;
-
-    int parent_id;
+#ifndef BPT_KEY_BITS
+#define BPT_KEY_BITS 32
+#endif
+#ifndef BPT_PAGE_ID_BITS
+#define BPT_PAGE_ID_BITS 32
+#endif
 
-    int page_type;
-    int num_items;
+#if BPT_KEY_BITS == 64
+typedef long long KeyType;
+#elif BPT_KEY_BITS == 32
+typedef int KeyType;
+#else
+#error "BPT_KEY_BITS must be 32 or 64"
+#endif
 
-    int next_leaf; 
-    int extra_ptr; 
-};
+#if BPT_PAGE_ID_BITS == 64
+typedef int64_t PageId;
+#elif BPT_PAGE_ID_BITS == 32
+typedef int32_t PageId;
+#else
+#error "BPT_PAGE_ID_BITS must be 32 or 64"
+#endif
 
-struct LeafEntry {
-    int key;
+const PageId INVALID_PAGE_ID = -1;
+
+const int VAR_MAX_KEY_SIZE = 256;
+const int VAR_MAX_VALUE_SIZE = 1024;
+
+const int EXTENT_PAGES = 256;
+const int MAX_EXTENT_PAGES = 16384;
+const int DEFAULT_POOL_FRAMES = 4096;
+const int MIN_POOL_FRAMES = 64;
+const int MAX_POOL_FILES = 256;
+const int SCAN_BATCH_ITEMS = 256;
+const int MULTI_PREFETCH_PAGES = 8;
+const int LANE_POOL_FRAMES = 32;
+const int MAX_EPOCH_THREADS = 256;
+const int IO_QUEUE_DEPTH = 64;
+const int IO_THREADS = 4;
+const int WRITEBACK_INTERVAL_MS = 10;
+const int WRITEBACK_BATCH = 32;
+
+#ifndef BPT_LEAF_APPEND_SLOTS
+#define BPT_LEAF_APPEND_SLOTS 0
+#endif
+const int LEAF_APPEND_SLOTS = BPT_LEAF_APPEND_SLOTS;
 
-    char data[TUPLE_SIZE];
+#ifndef BPT_LOOKUP_LANES
+#define BPT_LOOKUP_LANES 8
+#endif
+const int MULTI_LOOKUP_LANES = BPT_LOOKUP_LANES;
 
-};
+#ifndef BPT_OPTIMISTIC_RETRIES
+#define BPT_OPTIMISTIC_RETRIES 16
+#endif
+const int OPTIMISTIC_READ_RETRIES = BPT_OPTIMISTIC_RETRIES;
 
-struct InternalEntry {
+const int WAL_HEADER_SIZE = 4096;
+const long long WAL_CHECKPOINT_BYTES = 64LL * 1024 * 1024;
+enum PageType { PAGE_INVALID = 0, PAGE_INTERNAL = 1, PAGE_LEAF = 2, PAGE_META = 3, PAGE_FREE = 4 };
+enum PageFlags { PAGE_LOW_FENCE = 1 };
+struct PageHeader {
+    PageId page_id;
 
-    int key;
+    int page_type;
+    int level;
+    int num_items;
 
-    int ptr;
+    PageId right_link; 
+    PageId extra_ptr; 
+    int unsorted_items;
+    int flags;
 
+    long long lsn;
 };
+
 struct MetaPageData {
 
-    int root_page_id;
-    int total_pages_allocated;
+    PageId root_page_id;
+    PageId total_pages_allocated;
+
+    PageId free_list_head;
+    PageId free_page_count;
 
+    int page_size;
 };
+
+// A buffer frame is only as large as the page size of the file it caches; data is sized for the
+// largest supported page so that every layout can address its own pages through the same type.
 struct Page {
 
-    char data[PAGE_SIZE];
+    char data[MAX_PAGE_SIZE];
     PageHeader* getHeader() { return reinterpret_cast<PageHeader*>(data); }
 };
-const int LEAF_CAPACITY = (PAGE_SIZE - sizeof(PageHeader)) / sizeof(LeafEntry);
-
-const int INTERNAL_CAPACITY = (PAGE_SIZE - sizeof(PageHeader)) / sizeof(InternalEntry);
 #endif
@@ -7,20 +7,13 @@
 
 #include <chrono>
 #include <iomanip>
+#include <cstdlib>
+
+#include "c_api.h"
 using namespace std;
 using namespace chrono;
 
 #define DATA_SIZE 100
-extern "C" {
-    int writeData(int key, unsigned char* data);
-    int deleteData(int key);
-
-    unsigned char* readData(int key);
-
-    unsigned char** readRangeData(int lowerKey, int upperKey, int* n);
-
-    void closeIndex();
-}
 struct Stats {
     int insert_count = 0;
     int insert_success = 0;
@@ -77,6 +70,11 @@ int main(int argc, char* argv[]) {
 
     }
 
+    if (argc > 2) {
+
+        initWithPoolSize(atoi(argv[2]));
+    }
+
     
 
     cout << "========================================" << endl;
@@ -137,7 +135,7 @@ int main(int argc, char* argv[]) {
 
         
         if (operation == "INSERT") {
-            int key;
+            IndexKey key;
             string dataStr;
 
             
@@ -186,7 +184,7 @@ int main(int argc, char* argv[]) {
         }
         else if (operation == "READ") {
 
-            int key;
+            IndexKey key;
             
             if (!(iss >> key)) {
 
@@ -194,8 +192,10 @@ int main(int argc, char* argv[]) {
                 continue;
             }
             
+            unsigned char result[DATA_SIZE];
+
             auto start = high_resolution_clock::now();
-            unsigned char* result = readData(key);
+            int found = readDataInto(key, result);
             auto end = high_resolution_clock::now();
 
             
@@ -205,10 +205,8 @@ int main(int argc, char* argv[]) {
             stats.read_count++;
             
 
-            if (result != nullptr) {
+            if (found) {
                 stats.read_found++;
-                
-                delete[] result;
             } else {
                 stats.read_notfound++;
             }
@@ -217,7 +215,7 @@ int main(int argc, char* argv[]) {
 
         else if (operation == "DELETE") {
 
-            int key;
+            IndexKey key;
 
             
             if (!(iss >> key)) {
@@ -249,7 +247,7 @@ int main(int argc, char* argv[]) {
 
         else if (operation == "RANGE") {
 
-            int lowerKey, upperKey;
+            IndexKey lowerKey, upperKey;
             
 
             if (!(iss >> lowerKey >> upperKey)) {
@@ -280,9 +278,9 @@ int main(int argc, char* argv[]) {
             if (result != nullptr) {
                 for (int i = 0; i < n; i++) {
 
-                    delete[] result[i];
+                    free(result[i]);
                 }
-                delete[] result;
+                free(result);
             }
         }
 
@@ -404,6 +402,24 @@ int main(int argc, char* argv[]) {
     }
 
     
+    IndexStats istats;
+    getIndexStats(&istats);
+    long long lookups = istats.pool_hits + istats.pool_misses;
+
+    cout << "BUFFER POOL:" << endl;
+    cout << "  Hits:       " << istats.pool_hits << endl;
+    cout << "  Misses:     " << istats.pool_misses << endl;
+    cout << "  Hit Rate:   " << fixed << setprecision(2)
+         << (lookups > 0 ? 100.0 * istats.pool_hits / lookups : 0.0) << " %" << endl;
+    cout << "  Evictions:  " << istats.pool_evictions << endl;
+    cout << "  Writebacks: " << istats.pool_writebacks << endl;
+    cout << endl;
+
+    cout << "INDEX FILE:" << endl;
+    cout << "  Pages:      " << istats.file_pages << endl;
+    cout << "  Free Pages: " << istats.free_pages << endl;
+    cout << endl;
+
     cout << "========================================" << endl;
     
     